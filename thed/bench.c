@@ -0,0 +1,539 @@
+/* bench.c -- benchmark driver for thed
+ * Generates synthetic input files, times every I/O mode of thed on them
+ * and prints one csv line per mode and input:
+ * mode,input,bytes,runs,mb_s,min_ms,p50_ms,p90_ms,p99_ms,max_ms,peak_rss_kb
+ * mb_s is computed from the median run. Progress goes to stderr. */
+
+#define _FILE_OFFSET_BITS 64
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define EXE_NAME "thed_bench"
+#define KB (1LL << 10)
+#define MB (1LL << 20)
+#define GB (1LL << 30)
+#define GEN_BLK (1 << 20)
+#define MAX_RUNS 1000
+#define MAX_ARGS 16
+#define NEEDLE "THED"
+#define SPARSE_MARK 0x100000010LL
+#define PATH_LEN 512
+#define EXT_LEN 8
+#define TEXT_MARK 0x10000
+
+typedef uint8_t byte;
+
+// the kinds of generated input
+enum KIND {RANDOM, ZERO, TEXT, SPARSE};
+typedef enum KIND KIND;
+static const char * kind_name[] = {"random", "zero", "text", "sparse"};
+
+// the INPUT struct is a generated file and the dumps made from it
+struct INPUT
+{
+	KIND kind;
+	long long size;
+	char path[PATH_LEN];
+	char hex[PATH_LEN + EXT_LEN];	// path with an extension added
+	char csv[PATH_LEN + EXT_LEN];
+};
+typedef struct INPUT INPUT;
+
+// the RESULT struct has the times and the memory of one mode
+struct RESULT
+{
+	double ms[MAX_RUNS];
+	long peak_rss;
+};
+typedef struct RESULT RESULT;
+
+// for program arguments
+static const char * thed_bin = "./thed";
+static const char * data_dir = "./thed_bench_data";
+static int runs = 5;
+static long long max_size = GB;
+static long long max_conv = 64 * MB;
+static long long sparse_size = 5 * GB;
+static bool keep_data = false;
+
+void print_use(void);
+void check_args(int argc, char * argv[]);
+long long get_num(const char * str);
+void gen_input(INPUT * in);
+void gen_file(const char * path, KIND kind, long long size);
+void fill_block(byte * buff, size_t len, KIND kind, uint64_t * seed, long long * mark);
+void copy_file(const char * from, const char * to);
+void bench_input(INPUT * in);
+void bench(const char * mode, INPUT * in, char * const args[], const char * out, const char * restore);
+double run_once(char * const args[], const char * out, long * rss);
+int cmp_ms(const void * a, const void * b);
+double pcnt(const double * ms, int n, int p);
+
+int main(int argc, char * argv[])
+{
+	static const long long sizes[] = {KB, MB, 64 * MB, GB, 4 * GB};
+	static const KIND kinds[] = {RANDOM, ZERO, TEXT};
+	INPUT in;
+	int i, k;
+
+	check_args(argc, argv);
+
+	if (access(thed_bin, X_OK) != 0)
+	{
+		fprintf(stderr, "Err: can't run %s\n", thed_bin);
+		exit(1);
+	}
+
+	if (mkdir(data_dir, 0755) != 0 && access(data_dir, W_OK) != 0)
+	{
+		fprintf(stderr, "Err: can't create %s\n", data_dir);
+		exit(1);
+	}
+
+	printf("mode,input,bytes,runs,mb_s,min_ms,p50_ms,p90_ms,p99_ms,max_ms,peak_rss_kb\n");
+	fflush(stdout);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(*sizes) && sizes[i] <= max_size; ++i)
+	{
+		for (k = 0; k < sizeof(kinds) / sizeof(*kinds); ++k)
+		{
+			in.kind = kinds[k];
+			in.size = sizes[i];
+			gen_input(&in);
+			bench_input(&in);
+		}
+	}
+
+	if (sparse_size > 0)
+	{
+		in.kind = SPARSE;
+		in.size = sparse_size;
+		gen_input(&in);
+		bench_input(&in);
+	}
+
+	if (!keep_data)
+		rmdir(data_dir);
+
+	return 0;
+}
+
+void print_use(void)
+{
+	fprintf(stderr, "Use: %s [<options> ...]\n", EXE_NAME);
+	fprintf(stderr, "-t <thed> - binary to benchmark, ./thed by default.\n");
+	fprintf(stderr, "-d <dir> - where the input files go, %s by default.\n", data_dir);
+	fprintf(stderr, "-r <n> - runs per mode and input, 5 by default.\n");
+	fprintf(stderr, "-s <size> - biggest random/zero/text input, 1G by default.\n");
+	fprintf(stderr, "-c <size> - biggest input for -c, -b and -cb, 64M by default.\n");
+	fprintf(stderr, "-g <size> - size of the sparse input, 5G by default, 0 skips it.\n");
+	fprintf(stderr, "-k - keeps the input files.\n");
+	fprintf(stderr, "Sizes take a K, M or G suffix.\n");
+	exit(1);
+}
+
+void check_args(int argc, char * argv[])
+{
+	// reads the options; all but -k take a value
+	int i;
+
+	for (i = 1; i < argc; ++i)
+	{
+		const char * opt = argv[i];
+
+		if ('-' != opt[0] || '\0' == opt[1] || opt[2] != '\0')
+			print_use();
+
+		if ('k' == opt[1])
+		{
+			keep_data = true;
+			continue;
+		}
+
+		if (++i >= argc)
+			print_use();
+
+		switch (opt[1])
+		{
+			case 't': thed_bin = argv[i]; break;
+			case 'd': data_dir = argv[i]; break;
+			case 'r': runs = (int)get_num(argv[i]); break;
+			case 's': max_size = get_num(argv[i]); break;
+			case 'c': max_conv = get_num(argv[i]); break;
+			case 'g': sparse_size = get_num(argv[i]); break;
+			default: print_use(); break;
+		}
+	}
+
+	if (runs < 1 || runs > MAX_RUNS)
+	{
+		fprintf(stderr, "Err: runs must be between 1 and %d\n", MAX_RUNS);
+		exit(1);
+	}
+
+	if (sparse_size > 0 && sparse_size <= SPARSE_MARK)
+	{
+		fprintf(stderr, "Err: the sparse input must be bigger than 4G\n");
+		exit(1);
+	}
+}
+
+long long get_num(const char * str)
+{
+	// turns "64", "64K", "64M" or "64G" into a number
+	char * end;
+	long long n = strtoll(str, &end, 10);
+
+	switch (*end)
+	{
+		case 'K': case 'k': n *= KB; ++end; break;
+		case 'M': case 'm': n *= MB; ++end; break;
+		case 'G': case 'g': n *= GB; ++end; break;
+		default: break;
+	}
+
+	if (*end != '\0' || n < 0)
+	{
+		fprintf(stderr, "Err: bad number %s\n", str);
+		exit(1);
+	}
+
+	return n;
+}
+
+void gen_input(INPUT * in)
+{
+	/* writes the input file and, if the conversions are going to run
+	 * on it, its hex and csv dumps made by thed itself */
+
+	snprintf(in->path, sizeof(in->path), "%s/%s_%lld", data_dir, kind_name[in->kind], in->size);
+	snprintf(in->hex, sizeof(in->hex), "%s.hex", in->path);
+	snprintf(in->csv, sizeof(in->csv), "%s.csv", in->path);
+
+	fprintf(stderr, "generating %s\n", in->path);
+	gen_file(in->path, in->kind, in->size);
+
+	if (SPARSE != in->kind && in->size <= max_conv)
+	{
+		char * const hex_args[] = {(char *)thed_bin, in->path, NULL};
+		char * const csv_args[] = {(char *)thed_bin, "-c", in->path, in->csv, NULL};
+		long rss;
+
+		run_once(hex_args, in->hex, &rss);
+		run_once(csv_args, NULL, &rss);
+	}
+}
+
+void gen_file(const char * path, KIND kind, long long size)
+{
+	/* random is xorshift output, zero is all zeroes, text is lines of
+	 * words with NEEDLE at the first word start past every 64K, sparse is a hole with NEEDLE
+	 * just past 4G */
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	byte * buff;
+	long long done = 0, mark = TEXT_MARK;	// the next NEEDLE, from the block start
+
+	if (fd < 0)
+	{
+		fprintf(stderr, "Err: can't create %s\n", path);
+		exit(1);
+	}
+
+	if (SPARSE == kind)
+	{
+		if (ftruncate(fd, size) != 0 ||
+		pwrite(fd, NEEDLE, strlen(NEEDLE), SPARSE_MARK) != strlen(NEEDLE))
+		{
+			fprintf(stderr, "Err: can't write %s\n", path);
+			exit(1);
+		}
+		close(fd);
+		return;
+	}
+
+	if ( !(buff = (byte *)malloc(GEN_BLK)) )
+	{
+		fprintf(stderr, "Err: memory allocation failed\n");
+		exit(1);
+	}
+
+	while (done < size)
+	{
+		size_t len = (size - done < GEN_BLK) ? (size_t)(size - done) : GEN_BLK;
+
+		fill_block(buff, len, kind, &seed, &mark);
+		if (write(fd, buff, len) != (ssize_t)len)
+		{
+			fprintf(stderr, "Err: can't write %s\n", path);
+			exit(1);
+		}
+		done += len;
+	}
+
+	free(buff);
+	close(fd);
+}
+
+void fill_block(byte * buff, size_t len, KIND kind, uint64_t * seed, long long * mark)
+{
+	/* fills one block of a generated file, mark counts down to the next
+	 * NEEDLE of a text file so it doesn't depend on where the words end */
+	static const char * words[] = {"terminal", "hex", "editor", "dump", "offset",
+	"byte", "search", "replace", "line", "file", "binary", "value"};
+	uint64_t x = *seed;
+	size_t i = 0;
+
+	switch (kind)
+	{
+		case ZERO:
+			memset(buff, 0, len);
+			break;
+
+		case RANDOM:
+			for (i = 0; i < len; i += sizeof(x))
+			{
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				memcpy(buff + i, &x, (len - i < sizeof(x)) ? len - i : sizeof(x));
+			}
+			break;
+
+		case TEXT:
+			while (i < len)
+			{
+				const char * w;
+				size_t n;
+
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+
+				// a NEEDLE that doesn't fit waits for the next block
+				if (*mark <= (long long)i && len - i >= strlen(NEEDLE))
+				{
+					w = NEEDLE;
+					*mark += TEXT_MARK;
+				}
+				else
+					w = words[x % (sizeof(words) / sizeof(*words))];
+				n = strlen(w);
+				if (n > len - i)
+					n = len - i;
+				memcpy(buff + i, w, n);
+				i += n;
+
+				if (i < len)
+					buff[i++] = (0 == (x >> 60)) ? '\n' : ' ';
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	*mark -= len;
+	*seed = x;
+}
+
+void copy_file(const char * from, const char * to)
+{
+	// restores the input of a destructive mode between runs
+	static byte buff[GEN_BLK];
+	int fin = open(from, O_RDONLY), fout = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	ssize_t n;
+
+	if (fin < 0 || fout < 0)
+	{
+		fprintf(stderr, "Err: can't copy %s to %s\n", from, to);
+		exit(1);
+	}
+
+	while ((n = read(fin, buff, sizeof(buff))) > 0)
+	{
+		if (write(fout, buff, n) != n)
+		{
+			fprintf(stderr, "Err: can't write %s\n", to);
+			exit(1);
+		}
+	}
+
+	close(fin);
+	close(fout);
+}
+
+void bench_input(INPUT * in)
+{
+	// runs every mode on one input and removes its files afterwards
+	char tmp[PATH_LEN + EXT_LEN], out[PATH_LEN + EXT_LEN];
+	bool conv = (SPARSE != in->kind && in->size <= max_conv);
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", in->path);
+	snprintf(out, sizeof(out), "%s.out", in->path);
+
+	{
+		char * const args[] = {(char *)thed_bin, in->path, NULL};
+		bench("hex_dump", in, args, "/dev/null", NULL);
+	}
+
+	{
+		char * const args[] = {(char *)thed_bin, in->path, "-i", NULL};
+		bench("info", in, args, "/dev/null", NULL);
+	}
+
+	{
+		char * const args[] = {(char *)thed_bin, in->path, "-sa", NEEDLE, NULL};
+		bench("search_ascii", in, args, "/dev/null", NULL);
+	}
+
+	{
+		char * const args[] = {(char *)thed_bin, in->path, "-su", NEEDLE, NULL};
+		bench("search_unicode", in, args, "/dev/null", NULL);
+	}
+
+	{
+		char * const args[] = {(char *)thed_bin, in->path, "-sb", "54484544", NULL};
+		bench("search_bytes", in, args, "/dev/null", NULL);
+	}
+
+	{
+		char * const args[] = {(char *)thed_bin, in->path, "-sa", NEEDLE, "-j", "0", NULL};
+		bench("search_ascii_j0", in, args, "/dev/null", NULL);
+	}
+
+	if (conv)
+	{
+		{
+			char * const args[] = {(char *)thed_bin, "-c", in->path, out, NULL};
+			bench("csv_dump", in, args, "/dev/null", NULL);
+		}
+
+		{
+			char * const args[] = {(char *)thed_bin, "-b", in->hex, out, NULL};
+			bench("hex_to_bin", in, args, "/dev/null", NULL);
+		}
+
+		{
+			char * const args[] = {(char *)thed_bin, "-cb", in->csv, out, NULL};
+			bench("csv_to_bin", in, args, "/dev/null", NULL);
+		}
+
+		{
+			char * const args[] = {(char *)thed_bin, tmp, "-sa", NEEDLE, "-re", "thed", NULL};
+			bench("replace_all", in, args, "/dev/null", tmp);
+		}
+
+		unlink(in->hex);
+		unlink(in->csv);
+		unlink(out);
+		unlink(tmp);
+	}
+
+	if (!keep_data)
+		unlink(in->path);
+}
+
+void bench(const char * mode, INPUT * in, char * const args[], const char * out, const char * restore)
+{
+	/* times runs of one mode and prints its csv line
+	 * restore is a copy of the input made before every run */
+
+	RESULT res;
+	double med;
+	int i;
+
+	fprintf(stderr, "%s %s_%lld\n", mode, kind_name[in->kind], in->size);
+	res.peak_rss = 0;
+
+	for (i = 0; i < runs; ++i)
+	{
+		long rss;
+
+		if (restore)
+			copy_file(in->path, restore);
+
+		res.ms[i] = run_once(args, out, &rss);
+		if (rss > res.peak_rss)
+			res.peak_rss = rss;
+	}
+
+	qsort(res.ms, runs, sizeof(*res.ms), cmp_ms);
+	med = pcnt(res.ms, runs, 50);
+
+	printf("%s,%s,%lld,%d,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%ld\n", mode, kind_name[in->kind],
+	in->size, runs, (med > 0) ? (in->size / (double)MB) / (med / 1000.0) : 0.0,
+	res.ms[0], med, pcnt(res.ms, runs, 90), pcnt(res.ms, runs, 99), res.ms[runs - 1], res.peak_rss);
+	fflush(stdout);
+}
+
+double run_once(char * const args[], const char * out, long * rss)
+{
+	/* runs thed with stdout to out, or to /dev/null if out is NULL,
+	 * returns the wall time in ms and puts the peak rss in kB in *rss */
+
+	struct timespec t0, t1;
+	struct rusage ru;
+	int status;
+	pid_t pid;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if ((pid = fork()) < 0)
+	{
+		fprintf(stderr, "Err: fork failed\n");
+		exit(1);
+	}
+
+	if (0 == pid)
+	{
+		int fd = open(out ? out : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		int null = open("/dev/null", O_WRONLY);
+
+		if (fd < 0 || null < 0)
+			_exit(127);
+
+		dup2(fd, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		execv(args[0], args);
+		_exit(127);
+	}
+
+	if (wait4(pid, &status, 0, &ru) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "Err: %s %s failed\n", args[1], args[2] ? args[2] : "");
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	*rss = ru.ru_maxrss;
+	return (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+int cmp_ms(const void * a, const void * b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+double pcnt(const double * ms, int n, int p)
+{
+	// nearest rank percentile of the sorted ms
+	int rank = (p * n + 99) / 100;
+	return ms[(rank > 0 ? rank : 1) - 1];
+}
@@ -1,2 +1,7 @@
 #!/bin/bash
-gcc thed.c -o thed -Wall -s -O2 -m32
+gcc thed.c -o thed -Wall -s -O2 -pthread -lm
+
+# ./compile.sh bench [<bench options>] also builds and runs the benchmark
+if [ "$1" == "bench" ]; then
+	gcc bench.c -o thed_bench -Wall -O2 && ./thed_bench "${@:2}"
+fi
@@ -6,6 +6,11 @@ hex_dump="./thed_test_hex_dump.txt"
 hex_back_from="./back_from_hex_test"
 csv_dump="./thed_test_csv_dump.txt"
 csv_back_from="./back_from_csv_test"
+big_file="./thed_test_big_sparse"
+patch="./thed_test_patch"
+fixture="./thed_test_fixture"
+patterns="./thed_test_patterns"
+socket="./thed_test_socket"
 test_f=""
 
 main()
@@ -23,6 +28,11 @@ main()
 	for f in ${@:1}; do
 		test_file $f
 	done
+	
+	test_multi_search
+	test_encodings
+	test_server
+	test_big_file
 }
 
 test_file()
@@ -54,6 +64,320 @@ test_file()
 	else
 		echo "Err: csv test failed for $test_f"
 	fi
+	
+	# test parallel dumps, they must match the serial ones
+	$thed_bin $test_f -m 2>/dev/null > $hex_dump
+	$thed_bin $test_f -m -j 3 2>/dev/null | cmp -s $hex_dump -
+	if [ 0 -ne $? ]; then
+		echo "Err: parallel hex dump differs for $test_f"
+	fi
+	rm $hex_dump
+	
+	$thed_bin -c $test_f $csv_dump > /dev/null
+	$thed_bin -c $test_f - -j 3 2>/dev/null | cmp -s $csv_dump -
+	if [ 0 -ne $? ]; then
+		echo "Err: parallel csv dump differs for $test_f"
+	fi
+	rm $csv_dump
+	
+	# test - as stdin and stdout, it must match the runs on the file
+	cat $test_f | $thed_bin - 2>/dev/null | cmp -s - <($thed_bin $test_f 2>/dev/null)
+	if [ 0 -ne $? ]; then
+		echo "Err: stdin hex dump differs for $test_f"
+	fi
+	cat $test_f | $thed_bin -c - - 2>/dev/null | cmp -s - <($thed_bin -c $test_f - 2>/dev/null)
+	if [ 0 -ne $? ]; then
+		echo "Err: stdin csv dump differs for $test_f"
+	fi
+	$thed_bin $test_f 2>/dev/null | $thed_bin -b - - 2>/dev/null | cmp -s - $test_f
+	if [ 0 -ne $? ]; then
+		echo "Err: stdin hex to bin differs for $test_f"
+	fi
+	if [ "$(cat $test_f | $thed_bin - -sa e)" != "$($thed_bin $test_f -sa e)" ]; then
+		echo "Err: stdin search differs for $test_f"
+	fi
+	
+	# test parallel search, it must match the serial one
+	if [ "$($thed_bin $test_f -sa e)" != "$($thed_bin $test_f -sa e -j 3 -m)" ]; then
+		echo "Err: parallel search differs for $test_f"
+	fi
+	
+	# test edits, a dump of the edits must match the dump of the saved file
+	$thed_bin $test_f -e "i0=abcd,d0+2,w1=ef" -save $hex_back_from > /dev/null
+	$thed_bin $test_f -e "i0=abcd,d0+2,w1=ef" 2>/dev/null > $hex_dump
+	$thed_bin $hex_back_from 2>/dev/null | cmp -s $hex_dump -
+	if [ 0 -ne $? ]; then
+		echo "Err: edit test failed for $test_f"
+	fi
+	
+	# test diff, it must agree with cmp on the saved file
+	cmp -s $test_f $hex_back_from
+	same=$?
+	$thed_bin -d $test_f $hex_back_from 2>/dev/null | grep -q "^Files are identical"
+	if [ $same -ne $? ]; then
+		echo "Err: diff test failed for $test_f"
+	fi
+	
+	# test patches, applying the patch to the file must give the saved one back
+	$thed_bin -mkpatch $test_f $hex_back_from $patch > /dev/null
+	$thed_bin -apply $test_f $patch $csv_back_from > /dev/null
+	cmp -s $hex_back_from $csv_back_from
+	if [ 0 -ne $? ]; then
+		echo "Err: patch test failed for $test_f"
+	fi
+	rm $patch
+	rm $csv_back_from
+	
+	# test hashes, sha256 must match sha256sum and -j must match one thread
+	$thed_bin $test_f -H sha256 | grep -q "$(sha256sum < $test_f | cut -d ' ' -f 1)"
+	if [ 0 -ne $? ]; then
+		echo "Err: hash test failed for $test_f"
+	fi
+	if [ "$($thed_bin $test_f -H)" != "$($thed_bin $test_f -H -j 3)" ]; then
+		echo "Err: parallel hash test failed for $test_f"
+	fi
+	if [ "$($thed_bin $test_f -E 100)" != "$($thed_bin $test_f -E 100 -j 3)" ]; then
+		echo "Err: parallel entropy test failed for $test_f"
+	fi
+	if [ "$($thed_bin $test_f -S 2)" != "$($thed_bin $test_f -S 2 -j 3)" ]; then
+		echo "Err: parallel strings test failed for $test_f"
+	fi
+	rm $hex_dump
+	rm $hex_back_from
+}
+
+test_multi_search()
+{
+	# overlapping patterns, every match is listed by offset, then pattern
+	printf 'xxabcdexx' > $fixture
+	printf '# overlapping\na abcd\na bcd\na cde\nb 62 63\n\na xx\n' > $patterns
+	
+	expected="Match found at: 0 pattern 5
+Match found at: 0x2 pattern 1
+Match found at: 0x3 pattern 2
+Match found at: 0x3 pattern 4
+Match found at: 0x4 pattern 3
+Match found at: 0x7 pattern 5
+6 matches found."
+	
+	if [ "$($thed_bin $fixture -sf $patterns)" != "$expected" ]; then
+		echo "Err: multi-pattern search failed"
+	fi
+	
+	# -sf has no threads, -j must be refused rather than ignored
+	$thed_bin $fixture -sf $patterns -j 3 2>&1 | grep -q "^Err: -sf doesn't work with -j."
+	if [ 0 -ne $? ]; then
+		echo "Err: multi-pattern search took -j"
+	fi
+	
+	# the same over 40MB, mapped it's scanned in slices which cut through matches
+	yes xxabcdexx | head -n 4000000 > $fixture
+	$thed_bin $fixture -sf $patterns > $hex_dump
+	tail -n 1 $hex_dump | grep -q "^$((6 * 4000000)) matches found."
+	if [ 0 -ne $? ]; then
+		echo "Err: multi-pattern match count failed"
+	fi
+	$thed_bin $fixture -sf $patterns -mn | cmp -s $hex_dump -
+	if [ 0 -ne $? ]; then
+		echo "Err: mapped multi-pattern search differs"
+	fi
+	
+	rm $fixture $patterns $hex_dump
+}
+
+test_encodings()
+{
+	# the same non-ASCII word in UTF-8, UTF-16LE and UTF-16BE
+	word=$(printf 'gr\xc3\xbc\xc3\x9fe')
+	printf '..gr\xc3\xbc\xc3\x9fe..' > $fixture
+	printf 'g\0r\0\xfc\0\xdf\0e\0..' >> $fixture
+	printf '\0g\0r\0\xfc\0\xdf\0e..' >> $fixture
+	
+	for enc in "-su8 0x2" "-su 0xb" "-sube 0x17"; do
+		set -- $enc
+		if [ "$($thed_bin $fixture $1 "$word")" != "Match found at: $2
+1 match found." ]; then
+			echo "Err: $1 search failed"
+		fi
+	done
+	
+	expected="Match found at: 0x2 UTF-8
+Match found at: 0xb UTF-16LE
+Match found at: 0x17 UTF-16BE
+3 matches found."
+	
+	if [ "$($thed_bin $fixture -suall "$word")" != "$expected" ]; then
+		echo "Err: -suall search failed"
+	fi
+	$thed_bin $fixture -suall "$word" -j 3 2>&1 | grep -q "^Err: -suall doesn't work with -j."
+	if [ 0 -ne $? ]; then
+		echo "Err: -suall search took -j"
+	fi
+	
+	# a string that isn't UTF-8 can't be encoded
+	$thed_bin $fixture -su8 "$(printf 'gr\xffe')" 2>&1 | grep -q "isn't valid UTF-8"
+	if [ 0 -ne $? ]; then
+		echo "Err: invalid UTF-8 wasn't rejected"
+	fi
+	
+	rm $fixture
+}
+
+srv_ask()
+{
+	# sends one request line to the server, prints the response without the dot
+	python3 -c '
+import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.sendall((sys.argv[2] + "\n").encode())
+resp = b""
+while not (resp == b".\n" or resp.endswith(b"\n.\n")):
+	part = s.recv(65536)
+	if not part:
+		break
+	resp += part
+sys.stdout.write(resp[:-2].decode())
+' $socket "$1"
+}
+
+test_server()
+{
+	if ! command -v python3 > /dev/null; then
+		echo "No python3, server test skipped"
+		return 0
+	fi
+	
+	printf 'The quick brown fox jumps over the lazy dog.\nThe end.\n' > $fixture
+	$thed_bin --serve $socket 2>/dev/null &
+	srv_pid=$!
+	for i in $(seq 50); do
+		[ -S $socket ] && break
+		sleep 0.1
+	done
+	
+	# dump must match -wn, search and info the command line
+	if [ "$(srv_ask "dump $fixture 0:2,10:1,20:m1")" != "$($thed_bin $fixture -wn 0:2,10:1,20:m1)" ]; then
+		echo "Err: server dump differs from -wn"
+	fi
+	if [ "$(srv_ask "search $fixture -sa he")" != "$($thed_bin $fixture -sa he)" ]; then
+		echo "Err: server search differs"
+	fi
+	
+	if [ "$(srv_ask "info $fixture")" != "$($thed_bin $fixture -i)" ]; then
+		echo "Err: server info differs from -i"
+	fi
+	
+	# a replace must drop the cached search
+	srv_ask "replace $fixture -sa he -re HE" > /dev/null
+	if [ "$(srv_ask "search $fixture -sa he")" != "0 matches found." ]; then
+		echo "Err: server search wasn't refreshed after a replace"
+	fi
+	
+	# so must a change made outside the server
+	printf 'he' | dd of=$fixture bs=1 seek=1 conv=notrunc 2>/dev/null
+	if [ "$(srv_ask "search $fixture -sa he")" != "$($thed_bin $fixture -sa he)" ]; then
+		echo "Err: server search wasn't refreshed after a change"
+	fi
+	
+	kill $srv_pid
+	wait $srv_pid 2>/dev/null
+	rm -f $socket $fixture
+}
+
+test_big_file()
+{
+	# a sparse file a bit over 5GB with a marker past the 4GB boundary
+	truncate -s 5G $big_file
+	if [ 0 -ne $? ]; then
+		echo "Err: can't create $big_file"
+		return 1
+	fi
+	printf 'THED' | dd of=$big_file bs=1 seek=$((0x140000010)) conv=notrunc 2>/dev/null
+	
+	# test search past 4GB
+	$thed_bin $big_file -o 13FFFFF00 -sa THED | grep -q "Match found at: 0x140000010"
+	if [ 0 -ne $? ]; then
+		echo "Err: search past 4GB failed"
+	fi
+	
+	# test pattern search past 4GB
+	$thed_bin $big_file -o 13FFFFF00 -sp '00 {0-4} "TH" ?5 [40-4F]' | grep -q "5 matches found."
+	if [ 0 -ne $? ]; then
+		echo "Err: pattern search past 4GB failed"
+	fi
+	
+	# test case-insensitive search across a block and a -j chunk border
+	printf 'tHeD' | dd of=$big_file bs=1 seek=$((0x1200FFFFE)) conv=notrunc 2>/dev/null
+	printf 'ThEd' | dd of=$big_file bs=1 seek=$((0x120FFFFFF)) conv=notrunc 2>/dev/null
+	printf 't\0H\0e\0D\0' | dd of=$big_file bs=1 seek=$((0x1201FFFFD)) conv=notrunc 2>/dev/null
+	
+	expected="Match found at: 0x1200ffffe
+Match found at: 0x120ffffff
+Match found at: 0x140000010
+3 matches found."
+	
+	for par in "" "-j 3" "-m" "-j 3 -m"; do
+		if [ "$($thed_bin $big_file -o 120000000 -sai thed $par)" != "$expected" ]; then
+			echo "Err: -sai past 4GB failed with $par"
+		fi
+		$thed_bin $big_file -o 120000000 -sui THed $par | grep -q "^Match found at: 0x1201ffffd$"
+		if [ 0 -ne $? ]; then
+			echo "Err: -sui past 4GB failed with $par"
+		fi
+	done
+	
+	# test dump past 4GB
+	$thed_bin $big_file -o 140000010 -l 1 2>&1 | grep -q "First byte offset: 0x140000010"
+	if [ 0 -ne $? ]; then
+		echo "Err: dump offset past 4GB failed"
+	fi
+	
+	$thed_bin $big_file -o 140000010 -l 1 2>/dev/null | grep -q "^|54 48 45 44|__"
+	if [ 0 -ne $? ]; then
+		echo "Err: dump past 4GB failed"
+	fi
+	
+	# test dump windows past 4GB
+	$thed_bin $big_file -wn 0:1,140000010:1 2>&1 | tail -n 1 | grep -q "^|54 48 45 44|__"
+	if [ 0 -ne $? ]; then
+		echo "Err: dump windows past 4GB failed"
+	fi
+	
+	# a bad window must stop the run before anything is dumped
+	if [ -n "$($thed_bin $big_file -w 0:1,zz 2>&1 | grep -v "^Err: bad window zz")" ]; then
+		echo "Err: dump windows printed before a bad window"
+	fi
+	
+	# test undo of a journaled replace past 4GB
+	$thed_bin $big_file -o 140000010 -ra XXXX -J > /dev/null
+	$thed_bin $big_file -undo > /dev/null
+	$thed_bin $big_file -o 140000010 -l 1 2>/dev/null | grep -q "^|54 48 45 44|__"
+	if [ 0 -ne $? ]; then
+		echo "Err: undo past 4GB failed"
+	fi
+	
+	# test file info past 4GB
+	$thed_bin $big_file -i | grep -q "File ends at: 0x140000014"
+	if [ 0 -ne $? ]; then
+		echo "Err: file info past 4GB failed"
+	fi
+	
+	# test the search index past 4GB
+	$thed_bin $big_file -x build > /dev/null
+	$thed_bin $big_file -sa THED | grep -q "Match found at: 0x140000010"
+	if [ 0 -ne $? ]; then
+		echo "Err: indexed search past 4GB failed"
+	fi
+	
+	# a changed file must not use its old index
+	printf 'THED' | dd of=$big_file bs=1 seek=$((0x100)) conv=notrunc 2>/dev/null
+	$thed_bin $big_file -sa THED | grep -q "Match found at: 0x100"
+	if [ 0 -ne $? ]; then
+		echo "Err: stale index was used"
+	fi
+	
+	rm $big_file $big_file.thx $big_file.thj
 }
 
 main $@
@@ -6,13 +6,23 @@
  * thed reads only the hex. Any changes in the strings section has no effect. 
  * thed can also search for and replace ASCII, Unicode and byte sequences.
  * Number base conversion, bitwise operations, and the ASCII table are added for convenience. 
- * Compiled with: gcc thed.c -o thed -Wall -s -O2 -m32 */
+ * Compiled with: gcc thed.c -o thed -Wall -s -O2 -pthread */
 
 #include "thed.h"
 
 int main(int argc, char * argv[])
 {	
-	switch (check_args(argc, argv))
+	int opt = check_args(argc, argv);
+	
+	edit_open(opt);
+	run_opt(opt, argc, argv);
+	return 0;
+}
+
+void run_opt(int opt, int argc, char * argv[])
+{
+	// does what check_args() found in the arguments
+	switch (opt)
 	{
 		case OPT_DUMP:
 			hex_dump(input_file, line_num);
@@ -35,6 +45,50 @@ int main(int argc, char * argv[])
 		case OPT_FILE_INFO:
 			print_file_info(input_file);
 			break;
+		case OPT_IDX_BUILD:
+			idx_build(input_file);
+			break;
+		case OPT_WINDOWS:
+			hex_windows(input_file, windows);
+			break;
+		case OPT_SERVE:
+			serve(serve_path);
+			break;
+		case OPT_UNDO:
+			jrn_undo(input_file, false);
+			break;
+		case OPT_REDO:
+			jrn_undo(input_file, true);
+			break;
+		case OPT_COMMIT:
+			jrn_commit(input_file);
+			break;
+		case OPT_DIFF:
+			diff_files(input_file, diff_file);
+			break;
+		case OPT_MKPATCH:
+			delta_make(argv[2], argv[3], argv[4]);
+			break;
+		case OPT_APPLY:
+			delta_apply(argv[2], argv[3], argv[4]);
+			break;
+		case OPT_HASH:
+			hash_file(input_file, hash_algs);
+			break;
+		case OPT_STATS:
+			print_stats(input_file, stat_blk);
+			break;
+		case OPT_STRINGS:
+			print_strings(input_file, str_min);
+			break;
+		case OPT_SAVE:
+			if (!edits)
+			{
+				fprintf(stderr, "Err: %s needs -%c.\n", SAVE, EDIT);
+				exit(1);
+			}
+			view_save(&view, output_file);
+			break;
 		case OPT_CONV:
 			print_conv_nums(argv[2], from_base, to_base);
 			break;
@@ -64,8 +118,6 @@ int main(int argc, char * argv[])
 		default:
 			break;
 	}
-	
-	return 0;
 }
 
 int check_args(int argc, char * argv[])
@@ -78,18 +130,62 @@ int check_args(int argc, char * argv[])
 	
 	int opt = OPT_DUMP; // default
 	
+	// -mkpatch <old> <new> <patch>, -apply <old> <patch> <new>
+	if (0 == strcmp(argv[1], MKPATCH) || 0 == strcmp(argv[1], APPLY))
+	{
+		if (argc < 5)
+		{
+			fprintf(stderr, "Err: %s needs three files.\n", argv[1]);
+			exit(1);
+		}
+		
+		return (0 == strcmp(argv[1], MKPATCH)) ? OPT_MKPATCH : OPT_APPLY;
+	}
+	
+	if (0 == strcmp(argv[1], SERVE)) // --serve <socket>
+	{
+		if (argc < 3)
+		{
+			fprintf(stderr, "Err: no socket.\n");
+			exit(1);
+		}
+		
+		serve_path = argv[2];
+		return OPT_SERVE;
+	}
+	
 	// assume argv[1] is the input file
 	input_file = argv[1];
 	
 	int i; // look for -o, -l, -s, -r, -i
 	for (i = 2; i < argc; ++i) 
 	{
-		if (DASH == argv[i][0])
+		if (DASH == argv[i][0] && !is_std(argv[i]))
 		{
+			// -redo would pass for -re below, and -save for -s
+			if (0 == strcmp(argv[i], UNDO) || 0 == strcmp(argv[i], REDO) || 0 == strcmp(argv[i], COMMIT))
+			{
+				opt = (0 == strcmp(argv[i], UNDO)) ? OPT_UNDO : (0 == strcmp(argv[i], REDO)) ? OPT_REDO : OPT_COMMIT;
+				continue;
+			}
+			
+			if (0 == strcmp(argv[i], SAVE)) // -save <file>
+			{
+				if ( (i + 1) >= argc )
+				{
+					fprintf(stderr, "Err: no file to save to.\n");
+					exit(1);
+				}
+				
+				output_file = argv[++i];
+				opt = OPT_SAVE;
+				continue;
+			}
+			
 			if (OFFSET == argv[i][1]) // -o
 			{
 				if ( (i + 1) < argc )	// if there is something after -o
-					offset = strtol(argv[i + 1], NULL, 16);
+					offset = strtoll(argv[i + 1], NULL, 16);
 			}	
 			else if (LN_NUM == argv[i][1]) // -l
 			{
@@ -101,14 +197,109 @@ int check_args(int argc, char * argv[])
 						negative_line = true;
 						argv[i + 1][0] = '+'; 
 					}
-					line_num = strtol(argv[i + 1], NULL, 10);
+					line_num = strtoll(argv[i + 1], NULL, 10);
 					
 					if (MIDDLE == argv[i][2]) // -lm
 						hex_dump_middle = true;
 				}
 			}	
+			else if (MAP == argv[i][1]) // -m, -mn
+			{
+				if (NOT == argv[i][2])
+					map_never = true;
+				else
+					map_force = true;
+			}
+			else if (JOBS == argv[i][1]) // -j
+			{
+				if ( (i + 1) < argc )	// if there is something after -j
+				{
+					char * end;
+					
+					jobs = strtol(argv[i + 1], &end, 10);
+					if (end == argv[i + 1] || '\0' != *end)
+					{
+						fprintf(stderr, "Err: bad number of jobs %s.\n", argv[i + 1]);
+						exit(1);
+					}
+				}
+				
+				if (0 == jobs) // -j 0 is one job per cpu, as many as there can be
+				{
+					long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+					jobs = (cpus < 1) ? 1 : (cpus > MAX_JOBS) ? MAX_JOBS : cpus;
+				}
+				
+				if (1 > jobs || MAX_JOBS < jobs)
+				{
+					fprintf(stderr, "Err: number of jobs must be between 1 and %d.\n", MAX_JOBS);
+					exit(1);
+				}
+			}
+			else if (JOURNAL == argv[i][1]) // -J
+				journal = true;
+			else if (HASH == argv[i][1]) // -H [<hash>,...]
+			{
+				opt = OPT_HASH;
+				if ( (i + 1) < argc && DASH != argv[i + 1][0] )	// if there is a list of hashes
+					hash_algs = hash_parse(argv[i + 1]);
+			}
+			else if (STATS == argv[i][1]) // -E [<block size>]
+			{
+				opt = OPT_STATS;
+				if ( (i + 1) < argc && isdigit((byte)argv[i + 1][0]) )	// if there is a block size
+					stat_blk = strtoll(argv[i + 1], NULL, 10);
+			}
+			else if (STRINGS == argv[i][1]) // -S [<min length>]
+			{
+				opt = OPT_STRINGS;
+				if ( (i + 1) < argc && isdigit((byte)argv[i + 1][0]) )	// if there is a minimum length
+					str_min = strtoll(argv[i + 1], NULL, 10);
+			}
+			else if (EDIT == argv[i][1]) // -e
+			{
+				if ( (i + 1) < argc )	// if there is an edit list
+					edits = argv[i + 1];
+				else
+				{
+					fprintf(stderr, "Err: no edits.\n");
+					exit(1);
+				}
+			}
+			else if (WINDOW == argv[i][1]) // -w, -wn
+			{
+				if ( (i + 1) < argc )	// if there is a window list
+				{
+					windows = argv[i + 1];
+					window_header = (NOT != argv[i][2]);
+					opt = OPT_WINDOWS;
+				}
+				else
+				{
+					fprintf(stderr, "Err: no windows.\n");
+					exit(1);
+				}
+			}
+			else if (INDEX == argv[i][1]) // -x build, -xn
+			{
+				if (NOT == argv[i][2])
+					idx_never = true;
+				else if ( (i + 1) < argc && 0 == strcmp(argv[i + 1], "build") )
+					opt = OPT_IDX_BUILD;
+				else
+				{
+					fprintf(stderr, "Err: -%c takes build.\n", INDEX);
+					exit(1);
+				}
+			}
 			else if (SRCH == argv[i][1]) // -s
 			{
+				if ((ASCII == argv[i][2] || UNICODE == argv[i][2]) && NOCASE == argv[i][3]) // -sai, -sui
+					no_case = true;
+				
+				if (UNICODE == argv[i][2]) // -su, -sule, -sube, -su8, -suall
+					encoding = get_encoding(&argv[i][3 + no_case]);
+				
 				if ( (i + 1) < argc ) // if there is a search sequence
 				{
 					srch_rep_mode = &(argv[i][2]);
@@ -126,6 +317,9 @@ int check_args(int argc, char * argv[])
 				
 			if (REPLACE == argv[i][1] && EVERYTHING != argv[i][2]) // -r
 			{
+				if (UNICODE == argv[i][2]) // -ru, -rule, -rube, -ru8
+					encoding = get_encoding(&argv[i][3]);
+				
 				if ( (i + 1) < argc ) // if there is a replace sequence
 				{
 					srch_rep_mode = &(argv[i][2]);
@@ -159,8 +353,8 @@ int check_args(int argc, char * argv[])
 		}	
 	} 
 	
-	// base conversion
-	if (DASH == argv[1][0])
+	// base conversion, "-" alone is stdin
+	if (DASH == argv[1][0] && !is_std(argv[1]))
 	{
 		// parse for number base conversion
 		if (TO == argv[1][2] && 2 < argc)
@@ -221,6 +415,16 @@ int check_args(int argc, char * argv[])
 				else
 					opt = OPT_CSV;
 				break;
+			case DIFF: // -d
+				if ('\0' == argv[1][2] && 4 <= argc)
+				{
+					input_file = argv[2];
+					diff_file = argv[3];
+					opt = OPT_DIFF;
+				}
+				else
+					opt = BAD_OPT;
+				break;
 			case ASCII: // -a
 				if (REVERSE == argv[1][2])
 					opt = OPT_ASCII_RVRS; // -ar
@@ -266,9 +470,22 @@ int check_args(int argc, char * argv[])
 
 FILE * open_file(const char * fname, const char * accs)
 {
-	// opens a file and sets the file pointer
+	/* opens a file and sets the file pointer
+	 * "-" is stdin for reading and stdout for writing, the offset
+	 * of stdin is left to src_seek() since it might be a pipe */
 	FILE * fp;
 	
+	if (is_std(fname))
+	{
+		if (strchr(accs, '+'))
+		{
+			fprintf(stderr, "Err: can't write to stdin.\n");
+			exit(1);
+		}
+		
+		return ('r' == accs[0]) ? stdin : stdout;
+	}
+	
 	if ( !(fp = fopen(fname, accs)) )
 	{
 		fprintf(stderr, "Couldn't open file %s\n", fname);
@@ -276,566 +493,6885 @@ FILE * open_file(const char * fname, const char * accs)
 	}
 	
 	if (offset > 0) // set offset
-		fseek(fp, offset, SEEK_SET);
+		fseeko(fp, offset, SEEK_SET);
 	
 	return fp;
 }
 
-void csv_dump_to_bin(const char * fin, const char * fout)
+bool is_std(const char * fname)
+{
+	// true if fname is "-", the name of stdin and stdout
+	return (DASH == fname[0] && '\0' == fname[1]);
+}
+
+void src_open(SRC * src, const char * fname)
 {
-	// generates a binary from a csv dump
+	/* opens fname for reading and maps the whole file in memory if it's
+	 * a regular file bigger than MAP_MIN, or -m was given
+	 * pipes, special files and failed mappings keep using stdio */
 	
-	FILE * fpin, * fpout;
-	byte buff[MAX];
-	char csv_line[CSV_LN_LEN];
+	struct stat st;
+	void * map;
 	
-	fpin = open_file(fin, "r");
-	fpout = open_file(fout, "wb");	
+	src->fp = open_file(fname, "rb");
+	src->view = NULL;
+	src->map = NULL;
+	src->size = 0;
+	src->pos = 0;
+	src->skip = 0;
+	src->buff = NULL;
+	src->buff_len = 0;
+	src->buff_cap = 0;
 	
-	while (fgets(csv_line, CSV_LN_LEN, fpin) != NULL)
+	// the file as -e edited it, see view_open()
+	if (edit_view && 0 == strcmp(fname, edit_view->fname))
 	{
-		int bytes, pos;
-		const int step = 5;
-		for (pos = 0, bytes = 0; bytes < MAX; pos += step, ++bytes) 
-		{
-			int tmp_ch = (csv_line[pos] == '\n') ? csv_line[pos+1] : csv_line[pos];
-			if ('\0' == tmp_ch || END == tmp_ch)
-				break;
-			
-			hex_chars_to_byte(&csv_line[pos + 2], &buff[bytes]);
-		}
+		src->view = edit_view;
+		goto set_offset;
+	}
+	
+	// the server has it mapped already, see srv_run()
+	if (srv_kept && srv_kept->src.map && 0 == strcmp(fname, srv_kept->path))
+	{
+		src->map = srv_kept->src.map;
+		src->size = srv_kept->src.size;
+		madvise((void *)src->map, src->size, MADV_SEQUENTIAL);
+		goto set_offset;
+	}
+	
+	if (map_never || fstat(fileno(src->fp), &st) != 0 || !S_ISREG(st.st_mode) || 0 == st.st_size)
+		goto set_offset;
+		
+	if (!map_force && st.st_size < MAP_MIN)
+		goto set_offset;
+	
+	// a 32 bit build can't map more than its address space
+	if ((uintmax_t)st.st_size > SIZE_MAX)
+		goto set_offset;
+	
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(src->fp), 0);
+	if (MAP_FAILED == map)
+		goto set_offset;
+	
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	src->map = (const byte *)map;
+	src->size = st.st_size;
+	
+	set_offset:
+		src_seek(src, (offset > 0) ? offset : 0);
+}
+
+void src_seek(SRC * src, off_t pos)
+{
+	/* sets the offset of the next block
+	 * a pipe can only go forward, so the bytes up to pos
+	 * get dropped by the next src_next() */
+	
+	if (!src->map && !src->view && fseeko(src->fp, pos, SEEK_SET) != 0)
+	{
+		off_t done = src->pos - src->skip; // bytes already read
 		
-		if (fwrite(buff, sizeof(byte), bytes, fpout) != bytes)
+		if (ESPIPE != errno || pos < done)
 		{
-			fprintf(stderr, "Err: write error. Writing to %s has failed.\n", fout);
-			fclose(fpin);
-			fclose(fpout);
+			fprintf(stderr, "Err: can't seek to %#llx.\n", (unsigned long long)pos);
 			exit(1);
 		}
+		
+		src->skip = pos - done;
 	}
-	fprintf(stdout, "%s was written successfully.\n", output_file);
+	else
+		src->skip = 0;
 	
-	fclose(fpin);
-	fclose(fpout);
+	src->pos = pos;
+	src->buff_len = 0;
 }
 
-void hex_dump_to_bin(const char * fin, const char * fout)
+void src_skip(SRC * src)
 {
-	// generates a binary from a hex dump
-	
-	FILE * fpin, * fpout;
-	byte buff[MAX];
-	LINE ln;
-	size_t ln_hex_len = sizeof(ln.hxstr) / sizeof(char);
-	size_t ln_char_len = sizeof(ln.chstr) / sizeof(char);
-	
-	fpin = open_file(fin, "r");		
-	fpout = open_file(fout, "wb");	
-	
-	while (fgets(ln.hxstr, ln_hex_len, fpin) != NULL && END != ln.hxstr[0])
+	// reads and drops src->skip bytes from a pipe
+	while (src->skip > 0)
 	{
-		int bytes, pos;
-		const int step = 3;
-		for (pos = 0, bytes = 0; bytes < MAX; pos += step, ++bytes) 
-		{
-			int tmp_ch = ln.hxstr[pos+1];
-			if (END == tmp_ch || pos >= ln_hex_len-1)
-				break;
-				
-			hex_chars_to_byte(&ln.hxstr[pos + 1], &buff[bytes]);
-		}
+		size_t len = (src->skip < src->buff_cap) ? (size_t)src->skip : src->buff_cap;
+		size_t n = fread(src->buff, sizeof(byte), len, src->fp);
 		
-		if (fwrite(buff, sizeof(byte), bytes, fpout) != bytes)
+		if (0 == n)
 		{
-			fprintf(stderr, "Err: write error. Writing to %s has failed.", fout);
-			fclose(fpin);
-			fclose(fpout);
-			exit(1);
+			if (ferror(src->fp))
+			{
+				fprintf(stderr, "Err: read error.\n");
+				exit(1);
+			}
+			break;
 		}
 		
-		// get the string from the string section in the dump file and dispose of it
-		fgets(ln.chstr, ln_char_len, fpin);
+		src->skip -= n;
 	}
 	
-	fprintf(stdout, "%s was written successfully.\n", output_file);
-	
-	fclose(fpin);
-	fclose(fpout);
+	src->skip = 0;
 }
 
-void csv_dump(const char * fin, const char * fout)
+size_t src_next(SRC * src, size_t keep, const byte ** data)
 {
-	// generates a csv dump from binary
-	
-	FILE * fpin, * fpout;
-	byte buff[MAX];
-	char csv_line[CSV_LN_LEN];
-	int n;
+	/* points *data to the next block of the file and returns its length
+	 * the block starts with the last keep bytes of the previous one
+	 * a mapped file is handed out whole, so there's no copying
+	 * returns 0 when there's nothing new to read, *data then points
+	 * to the kept bytes */
 	
-	fpin = open_file(fin, "rb");	
-	fpout = open_file(fout, "w");	
+	size_t n;
 	
-	while ( (n = fread(buff, sizeof(byte), MAX, fpin)) > 0 )
+	if (src->map)
 	{
+		*data = src->map + src->pos - keep;
+		if (src->pos >= src->size)
+			return 0;
 		
-		int i, j;
-		for (i = 0, j = 0; i < n; ++i) // prepare csv string
+		n = src->size - src->pos + keep;
+		src->pos = src->size;
+		return n;
+	}
+	
+	if (keep + BLK_SIZE > src->buff_cap)
+	{
+		src->buff_cap = keep + BLK_SIZE;
+		if ( !(src->buff = (byte *)realloc(src->buff, src->buff_cap)) )
 		{
-			csv_line[j++] = '0';
-			csv_line[j++] = 'x';	
-			csv_line[j++] = HEXTBL[(buff[i] >> 4) & 0xF];
-			csv_line[j++] = HEXTBL[buff[i] & 0xF];
-			csv_line[j++] = ',';
+			fprintf(stderr, "Err: unable to allocate read buffer.\n");
+			exit(1);
 		}
-		csv_line[j++] = '\n';
-		csv_line[j] = '\0';
-		
-		fprintf(fpout, "%s", csv_line);
 	}
 	
-	if (ferror(fpin))
+	if (src->skip > 0)
+		src_skip(src);
+	
+	memmove(src->buff, src->buff + src->buff_len - keep, keep);
+	
+	if (src->view)
+		n = view_read(src->view, src->buff + keep, BLK_SIZE, src->pos);
+	else
+		n = fread(src->buff + keep, sizeof(byte), BLK_SIZE, src->fp);
+	
+	if (ferror(src->fp))
 	{
 		fprintf(stderr, "Err: read error.\n");
 		exit(1);
 	}
 	
-	// mark end of dump
-	putc(END, fpout);
-	putc(END, fpout);
+	*data = src->buff;
+	src->buff_len = keep + n;
+	src->pos += n;
 	
-	fprintf(stdout, "CSV written to %s.\n", output_file);
-	fclose(fpin);
-	fclose(fpout);
+	return n ? src->buff_len : 0;
 }
 
-void hex_dump(const char * fname, long line_num)
+off_t src_size(SRC * src)
 {
-	// generates a hex dump from binary
+	// returns the file size, or -1 if src isn't a regular file
+	struct stat st;
 	
-	FILE * fp;
-	byte buff[MAX];
-	LINE ln;
-	int n;
-	long lines_done = 0L;
-	bool is_n_eof = false;
+	if (src->map)
+		return src->size;
 	
-	fp = open_file(fname, "rb");
+	if (src->view)
+		return src->view->size;
 	
-	if (hex_dump_middle) // -lm
-	{
-		offset -= line_num * 16;
-		line_num *= 2;
-		++line_num;
-		fseek(fp, offset, SEEK_SET);
-		negative_line = false;
-	}
+	if (fstat(fileno(src->fp), &st) != 0 || !S_ISREG(st.st_mode))
+		return -1;
 	
-	if (negative_line) // -l -<line num>
-	{	
-		offset -= line_num * 16;
-		fseek(fp, offset, SEEK_SET);
-	}
+	return st.st_size;
+}
+
+size_t src_pread(const SRC * src, byte * buff, size_t len, off_t pos)
+{
+	/* reads up to len bytes from pos without moving the file position
+	 * so it's safe to call from more than one thread
+	 * returns the number of bytes read, less than len only at the eof */
 	
-	if (0 > offset)
+	size_t done = 0;
+	
+	if (src->view)
+		return view_read(src->view, buff, len, pos);
+	
+	while (done < len)
 	{
-		fprintf(stderr, "Err: negative offset.\n");
-		exit(1);
+		ssize_t n = pread(fileno(src->fp), buff + done, len - done, pos + done);
+		
+		if (0 == n)
+			break;
+		
+		if (n < 0)
+		{
+			fprintf(stderr, "Err: read error.\n");
+			exit(1);
+		}
+		
+		done += n;
 	}
 	
-	// print offset table and first byte offset to stderr
-	// so it won't get in the file if stdout is redirected
-	fprintf(stderr, " First byte offset: %#lx\n", offset);
-	fprintf(stderr, "%s\n\n", OFFSET_TBL);
+	return done;
+}
 
-	while ( (n = fread(buff, sizeof(byte), MAX, fp)) > 0 )
-	{	
-		if (line_num > 0)
-			if (line_num == lines_done)
-			{
-				// don't print end characters if
-				is_n_eof = true;
-				break;
-			}
+void src_close(SRC * src)
+{
+	// unmaps and closes what src_open() opened, the server's mapping stays
+	if (src->map && !(srv_kept && src->map == srv_kept->src.map))
+		munmap((void *)src->map, src->size);
+	
+	free(src->buff);
+	fclose(src->fp);
+}
+
+void csv_dump_to_bin(const char * fin, const char * fout)
+{
+	/* generates a binary from a csv dump
+	 * the values can be spread over any number of lines */
+	
+	SRC src;
+	OUT out;
+	FILE * fpout;
+	const byte * data;
+	size_t n, carry = 0;
+	unsigned long long line = 0;
+	bool is_end = false;
+	
+	src_open(&src, fin);
+	fpout = open_file(fout, "wb");	
+	out_open(&out, fileno(fpout));
+	
+	/* only whole lines are decoded, the rest is carried to the next block
+	 * a line longer than a block is decoded up to its last separator,
+	 * so the carry never grows past one value */
+	while (!is_end && (n = src_next(&src, carry, &data)) > 0)
+	{
+		const byte * ln = data, * nl, * end = data + n;
 		
-		int i, j;
-		for (i = 0, j = 0; i < n; ++i) // preapare hex string
+		while (!is_end && (nl = (const byte *)memchr(ln, '\n', end - ln)))
 		{
-			ln.hxstr[j++] = (i % 4) ? ' ' : SPRT;	
-			ln.hxstr[j++] = HEXTBL[(buff[i] >> 4) & 0xF];
-			ln.hxstr[j++] = HEXTBL[buff[i] & 0xF];
+			is_end = csv_line_to_bin(&out, ln, nl - ln, ++line);
+			ln = nl + 1;
 		}
 		
-		if (n < MAX) // n < MAX if it's at the eof, or error
+		if (!is_end && end - ln >= BLK_SIZE)
 		{
-			ln.hxstr[j++] = (i % 4) ? ' ' : SPRT;
-			// mark end of dump
-			ln.hxstr[j++] = END;
-			ln.hxstr[j++] = END;
-			/* if the buffer fits perfectly we won't detect eof
-			 * in the current string and end marks won't be printed 
-			 * since !(n < MAX) */
-			is_n_eof = true;
-		}
-		
-		ln.hxstr[j] = '\0';
-		
-		i = 0;	
-		ln.chstr[i] = SPRT;					
-		for (i = 1, j = 0; j < n; ++i, ++j)	// prepare the string section
-			ln.chstr[i] = !iscntrl(buff[j]) ? buff[j] : '.';
+			const byte * sep = end - 1;
 			
-		ln.chstr[i] = '\0';
-		
-		// print the whole thing
-		fprintf(stdout, "%-*s%-*s\n", MAX*3, ln.hxstr, MAX, ln.chstr); 
-		++lines_done;
+			while (sep > ln && ',' != *sep && ' ' != *sep && '\t' != *sep)
+				--sep;
+			
+			is_end = csv_line_to_bin(&out, ln, sep - ln, line + 1);
+			ln = sep;
+		}
+		carry = end - ln;
 	}
 	
-	if (ferror(fp))
+	if (!is_end && carry > 0) // the last line has no '\n'
+		csv_line_to_bin(&out, data, carry, ++line);
+	
+	out_close(&out);
+	// stdout might be the binary itself
+	fprintf(is_std(fout) ? stderr : stdout, "%s was written successfully.\n", output_file);
+	
+	src_close(&src);
+	if (fclose(fpout) != 0)
 	{
-		fprintf(stderr, "Err: read error.\n");
+		fprintf(stderr, "Err: write error. Writing to %s has failed.\n", fout);
 		exit(1);
 	}
-	
-		// print ending characters if n was never < MAX
-		if (!is_n_eof)
-			fprintf(stdout, "%c%c\n", END, END);
-			
-	fclose(fp);
 }
 
-void search(const char mode, const char * fname, const char * sequence)
+bool csv_line_to_bin(OUT * out, const byte * ln, size_t len, unsigned long long line)
 {
-	// string and byte sequence search
+	/* decodes the 0xHH values of one csv line into out
+	 * values are separated by commas and white space
+	 * returns true if the line has the end of dump mark */
 	
-	// only -sa -su -sb are accepted
-	if (BIN != mode && ASCII != mode && UNICODE != mode)
+	byte buff[BLK_SIZE / 64];
+	size_t i = 0, n = 0;
+	
+	while (i < len)
 	{
-		fprintf(stderr, "Err: invalid search mode.\n");
-		exit(1);
+		byte ch = ln[i];
+		
+		if (',' == ch || ' ' == ch || '\t' == ch || '\r' == ch)
+		{
+			++i;
+			continue;
+		}
+		
+		if (END == ch)
+			break;
+		
+		if (i + 4 > len || '0' != ch || 'x' != (ln[i + 1] | 0x20) || 
+		NOT_HEX == HEX_VAL[ln[i + 2]] || NOT_HEX == HEX_VAL[ln[i + 3]])
+		{
+			fprintf(stderr, "Err: bad csv value on line %llu.\n", line);
+			exit(1);
+		}
+		
+		buff[n++] = (HEX_VAL[ln[i + 2]] << 4) | HEX_VAL[ln[i + 3]];
+		i += 4;
+		
+		if (sizeof(buff) == n)
+		{
+			out_write(out, buff, n);
+			n = 0;
+		}
 	}
 	
-	FILE * fp;
-	char ch;
-	int n;
-	byte * byte_buff;
-	int buff_len = 0;
+	out_write(out, buff, n);
+	return (i < len);
+}
+
+void hex_dump_to_bin(const char * fin, const char * fout)
+{
+	/* generates a binary from a hex dump
+	 * everything after the hex section of a line is ignored */
+	
+	SRC src;
+	OUT out;
+	FILE * fpout;
+	const byte * data;
+	size_t n, carry = 0;
+	unsigned long long line = 0;
+	bool is_end = false, skip_ln = false;
+	
+	src_open(&src, fin);
+	fpout = open_file(fout, "wb");	
+	out_open(&out, fileno(fpout));
+	
+	/* only whole lines are decoded, the rest is carried to the next block
+	 * a line longer than a block is decoded at once, since its hex section
+	 * is already there, and the rest of it is skipped */
+	while (!is_end && (n = src_next(&src, carry, &data)) > 0)
+	{
+		const byte * ln = data, * nl, * end = data + n;
+		
+		if (skip_ln)
+		{
+			if ( !(nl = (const byte *)memchr(ln, '\n', end - ln)) )
+			{
+				carry = 0;
+				continue;
+			}
+			
+			ln = nl + 1;
+			skip_ln = false;
+		}
+		
+		while (!is_end && (nl = (const byte *)memchr(ln, '\n', end - ln)))
+		{
+			is_end = hex_line_to_bin(&out, ln, nl - ln, ++line);
+			ln = nl + 1;
+		}
+		
+		if (!is_end && end - ln >= BLK_SIZE)
+		{
+			is_end = hex_line_to_bin(&out, ln, end - ln, ++line);
+			skip_ln = true;
+			ln = end;
+		}
+		carry = end - ln;
+	}
+	
+	if (!is_end && carry > 0) // the last line has no '\n'
+		hex_line_to_bin(&out, data, carry, ++line);
+	
+	out_close(&out);
+	// stdout might be the binary itself
+	fprintf(is_std(fout) ? stderr : stdout, "%s was written successfully.\n", output_file);
+	
+	src_close(&src);
+	if (fclose(fpout) != 0)
+	{
+		fprintf(stderr, "Err: write error. Writing to %s has failed.\n", fout);
+		exit(1);
+	}
+}
+
+bool hex_line_to_bin(OUT * out, const byte * ln, size_t len, unsigned long long line)
+{
+	/* decodes the hex section of one hex dump line into out
+	 * the section is up to MAX groups of a separator and two hex digits
+	 * it ends early at the end of dump mark, or at a group of spaces
+	 * returns true if the line has the end of dump mark */
+	
+	byte * bytes = (byte *)out_reserve(out, MAX);
+	int i;
+	
+	if (len > 0 && END == ln[0])
+		return true;
+		
+#ifdef X86_SIMD
+	if (len >= MAX * 3 && __builtin_cpu_supports("ssse3") && hex_line_decode_ssse3(ln, bytes))
+	{
+		out->len += MAX;
+		return false;
+	}
+#endif
+	
+	for (i = 0; i < MAX; ++i) 
+	{
+		size_t pos = i * 3;
+		
+		if (pos + 1 >= len || (' ' == ln[pos + 1] && ' ' == ln[pos]))
+			break;
+		
+		if (END == ln[pos + 1])
+		{
+			out->len += i;
+			return true;
+		}
+		
+		if (pos + 2 >= len || (SPRT != ln[pos] && ' ' != ln[pos]) ||
+		NOT_HEX == HEX_VAL[ln[pos + 1]] || NOT_HEX == HEX_VAL[ln[pos + 2]])
+		{
+			fprintf(stderr, "Err: bad hex value on line %llu.\n", line);
+			exit(1);
+		}
+		
+		bytes[i] = (HEX_VAL[ln[pos + 1]] << 4) | HEX_VAL[ln[pos + 2]];
+	}
+	
+	out->len += i;
+	return false;
+}
+
+#ifdef X86_SIMD
+/* the digits of bytes 0 - 7 and 8 - 15 of a full hex dump line are
+ * gathered from its three 16 byte parts v0, v1, v2 into pairs */
+#define HEX_GATHER_P0_V0 1, 2, 4, 5, 7, 8, 10, 11, 13, 14, -128, -128, -128, -128, -128, -128
+#define HEX_GATHER_P0_V1 -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, 1, 3, 4, 6, 7
+#define HEX_GATHER_P1_V1 9, 10, 12, 13, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128
+#define HEX_GATHER_P1_V2 -128, -128, -128, -128, -128, 0, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15
+#define HEX_SPRT_V0 0x9249
+#define HEX_SPRT_V1 0x4924
+#define HEX_SPRT_V2 0x2492
+
+__attribute__((target("ssse3")))
+static inline __m128i hex_values(__m128i digits, __m128i * bad)
+{
+	/* turns 16 hex digits of either case into their values
+	 * and ors 0xFF into *bad for every character which isn't one */
+	__m128i dec = _mm_sub_epi8(digits, _mm_set1_epi8('0'));
+	__m128i alpha = _mm_sub_epi8(_mm_or_si128(digits, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_dec = _mm_cmpeq_epi8(_mm_subs_epu8(dec, _mm_set1_epi8(9)), _mm_setzero_si128());
+	__m128i is_alpha = _mm_cmpeq_epi8(_mm_subs_epu8(alpha, _mm_set1_epi8(5)), _mm_setzero_si128());
+	
+	*bad = _mm_or_si128(*bad, _mm_andnot_si128(_mm_or_si128(is_dec, is_alpha), _mm_set1_epi8(-1)));
+	return _mm_or_si128(_mm_and_si128(is_dec, dec), 
+	_mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+bool hex_line_decode_ssse3(const byte * ln, byte * bytes)
+{
+	/* decodes the 16 values of a full hex dump line at once
+	 * returns false without writing if any digit is bad, so the
+	 * scalar code can find the end of dump mark or report the error */
+	
+	__m128i v0 = _mm_loadu_si128((const __m128i *)ln);
+	__m128i v1 = _mm_loadu_si128((const __m128i *)(ln + 16));
+	__m128i v2 = _mm_loadu_si128((const __m128i *)(ln + 32));
+	__m128i bad = _mm_setzero_si128();
+	__m128i sep = _mm_set1_epi8(SPRT), blank = _mm_set1_epi8(' ');
+	__m128i p0 = _mm_or_si128(_mm_shuffle_epi8(v0, _mm_setr_epi8(HEX_GATHER_P0_V0)),
+	_mm_shuffle_epi8(v1, _mm_setr_epi8(HEX_GATHER_P0_V1)));
+	__m128i p1 = _mm_or_si128(_mm_shuffle_epi8(v1, _mm_setr_epi8(HEX_GATHER_P1_V1)),
+	_mm_shuffle_epi8(v2, _mm_setr_epi8(HEX_GATHER_P1_V2)));
+	
+	// every pair of values becomes 16 * high + low
+	p0 = _mm_maddubs_epi16(hex_values(p0, &bad), _mm_set1_epi16(0x0110));
+	p1 = _mm_maddubs_epi16(hex_values(p1, &bad), _mm_set1_epi16(0x0110));
+	
+	// the separators are at every third character
+	if ((_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v0, sep), _mm_cmpeq_epi8(v0, blank))) & HEX_SPRT_V0) != HEX_SPRT_V0 ||
+	(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v1, sep), _mm_cmpeq_epi8(v1, blank))) & HEX_SPRT_V1) != HEX_SPRT_V1 ||
+	(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v2, sep), _mm_cmpeq_epi8(v2, blank))) & HEX_SPRT_V2) != HEX_SPRT_V2 ||
+	_mm_movemask_epi8(bad))
+		return false;
+	
+	_mm_storeu_si128((__m128i *)bytes, _mm_packus_epi16(p0, p1));
+	return true;
+}
+#endif
+
+void out_open(OUT * out, int fd)
+{
+	// sets up an OUT_SIZE buffer for fd
+	out->fd = fd;
+	out->len = 0;
+	
+	if ( !(out->buff = (char *)malloc(OUT_SIZE)) )
+	{
+		fprintf(stderr, "Err: unable to allocate output buffer.\n");
+		exit(1);
+	}
+}
+
+char * out_reserve(OUT * out, size_t len)
+{
+	/* returns a place for len more bytes in the buffer, flushing it first
+	 * if there's no room; len can't be more than OUT_SIZE
+	 * the bytes count once out->len is moved past them */
+	if (out->len + len > OUT_SIZE)
+		out_flush(out);
+	
+	return out->buff + out->len;
+}
+
+void out_write(OUT * out, const void * data, size_t len)
+{
+	// copies len bytes to the buffer
+	while (len > 0)
+	{
+		size_t n = OUT_SIZE - out->len;
+		
+		if (0 == n)
+		{
+			out_flush(out);
+			continue;
+		}
+		
+		if (n > len)
+			n = len;
+		
+		memcpy(out->buff + out->len, data, n);
+		out->len += n;
+		data = (const byte *)data + n;
+		len -= n;
+	}
+}
+
+void out_printf(OUT * out, const char * fmt, ...)
+{
+	// fprintf() into the buffer
+	va_list args;
+	int n;
+	
+	va_start(args, fmt);
+	n = vsnprintf(out->buff + out->len, OUT_SIZE - out->len, fmt, args);
+	va_end(args);
+	
+	if (n >= 0 && (size_t)n >= OUT_SIZE - out->len)
+	{
+		// didn't fit, try again in an empty buffer
+		out_flush(out);
+		va_start(args, fmt);
+		n = vsnprintf(out->buff, OUT_SIZE, fmt, args);
+		va_end(args);
+	}
+	
+	if (n < 0 || (size_t)n >= OUT_SIZE - out->len)
+	{
+		fprintf(stderr, "Err: output formatting failed.\n");
+		exit(1);
+	}
+	
+	out->len += n;
+}
+
+void out_flush(OUT * out)
+{
+	// writes the whole buffer
+	write_all(out->fd, out->buff, out->len);
+	out->len = 0;
+}
+
+void write_all(int fd, const char * buff, size_t len)
+{
+	// writes len bytes with as few write() calls as possible
+	size_t done = 0;
+	
+	while (done < len)
+	{
+		ssize_t n = write(fd, buff + done, len - done);
+		
+		if (n < 0 && EINTR == errno)
+			continue;
+		
+		if (n <= 0)
+		{
+			fprintf(stderr, "Err: write error.\n");
+			exit(1);
+		}
+		done += n;
+	}
+}
+
+void out_close(OUT * out)
+{
+	// flushes and frees the buffer, the descriptor stays open
+	out_flush(out);
+	free(out->buff);
+	out->buff = NULL;
+}
+
+void csv_dump(const char * fin, const char * fout)
+{
+	// generates a csv dump from binary
+	
+	SRC src;
+	OUT out;
+	FILE * fpout;
+	const byte * data;
+	size_t n, k;
+	off_t file_end;
+	
+	src_open(&src, fin);
+	fpout = open_file(fout, "w");	
+	out_open(&out, fileno(fpout));
+	
+	// whole lines can be formatted by more than one thread
+	if (jobs > 1 && (file_end = src_size(&src)) > src.pos)
+		dump_parallel(&src, &out, file_end, true);
+	
+	while ( (n = src_next(&src, 0, &data)) > 0 )
+	{
+		for (k = 0; k < n; ) 
+		{
+			size_t len = (n - k < HEX_BATCH * MAX) ? n - k : HEX_BATCH * MAX;
+			
+			out.len += csv_lines(out_reserve(&out, (len + MAX - 1) / MAX * CSV_LN_LEN), data + k, len);
+			k += len;
+		}
+	}
+	
+	// mark end of dump
+	out_write(&out, "__", 2);
+	out_close(&out);
+	
+	fprintf(is_std(fout) ? stderr : stdout, "CSV written to %s.\n", output_file);
+	src_close(&src);
+	fclose(fpout);
+}
+
+size_t csv_lines(char * out, const byte * data, size_t len)
+{
+	/* formats len bytes from data into out as csv lines of MAX bytes
+	 * the last of which can be shorter, and returns the number
+	 * of characters written */
+	
+	size_t k, j = 0;
+	
+	for (k = 0; k < len; k += MAX) 
+	{
+		const byte * buff = data + k;
+		int i, ln_len = (len - k < MAX) ? len - k : MAX;
+		
+		for (i = 0; i < ln_len; ++i) // prepare csv string
+		{
+			out[j++] = '0';
+			out[j++] = 'x';	
+			out[j++] = HEXTBL[(buff[i] >> 4) & 0xF];
+			out[j++] = HEXTBL[buff[i] & 0xF];
+			out[j++] = ',';
+		}
+		out[j++] = '\n';
+	}
+	
+	return j;
+}
+
+long long dump_parallel(SRC * src, OUT * out, off_t stop, bool csv)
+{
+	/* formats the whole lines between src->pos and stop in DUMP_SEG long
+	 * segments, up to jobs of them at a time, each in its own thread
+	 * the segments are written in order once a round is done, so the output
+	 * is the same as one thread's; src is left after the last whole line
+	 * for the caller to finish the dump, returns the number of lines */
+	
+	DUMP_JOB job_arr[MAX_JOBS];
+	off_t start = src->pos, end = src->pos + (stop - src->pos) / MAX * MAX;
+	long long lines;
+	int i, n;
+	
+	for (i = 0; i < jobs; ++i) 
+	{
+		job_arr[i].src = src;
+		job_arr[i].csv = csv;
+		job_arr[i].buff = NULL;
+		job_arr[i].text = NULL;
+	}
+	
+	out_flush(out);
+	
+	while (start < end)
+	{
+		for (n = 0; n < jobs && start < end; ++n, start += DUMP_SEG) 
+		{
+			job_arr[n].start = start;
+			job_arr[n].len = (end - start > DUMP_SEG) ? DUMP_SEG : end - start;
+		}
+		
+		run_jobs(dump_job, job_arr, sizeof(DUMP_JOB), n);
+		
+		for (i = 0; i < n; ++i) 
+			write_all(out->fd, job_arr[i].text, job_arr[i].text_len);
+	}
+	
+	for (i = 0; i < jobs; ++i) 
+	{
+		free(job_arr[i].buff);
+		free(job_arr[i].text);
+	}
+	
+	lines = (end - src->pos) / MAX;
+	src_seek(src, end);
+	return lines;
+}
+
+void * dump_job(void * arg)
+{
+	// formats one segment for dump_parallel()
+	
+	DUMP_JOB * job = (DUMP_JOB *)arg;
+	const byte * data;
+	
+	if (!job->text && !(job->text = (char *)malloc(DUMP_SEG / MAX * (job->csv ? CSV_LN_LEN : HEX_LN_LEN))) )
+	{
+		fprintf(stderr, "Err: unable to allocate output buffer.\n");
+		exit(1);
+	}
+	
+	if (job->src->map)
+		data = job->src->map + job->start;
+	else
+	{
+		if (!job->buff && !(job->buff = (byte *)malloc(DUMP_SEG)) )
+		{
+			fprintf(stderr, "Err: unable to allocate read buffer.\n");
+			exit(1);
+		}
+		
+		// the file can shrink while it's dumped
+		if (src_pread(job->src, job->buff, job->len, job->start) != job->len)
+		{
+			fprintf(stderr, "Err: read error.\n");
+			exit(1);
+		}
+		data = job->buff;
+	}
+	
+	if (job->csv)
+		job->text_len = csv_lines(job->text, data, job->len);
+	else
+		job->text_len = hex_lines(job->text, data, job->len / MAX);
+	
+	return NULL;
+}
+
+void hex_dump(const char * fname, long long line_num)
+{
+	// generates a hex dump from binary
+	
+	SRC src;
+	OUT out;
+	const byte * data;
+	size_t n, k;
+	long long lines_done = 0LL;
+	bool is_n_eof = false;
+	off_t file_end;
+	
+	src_open(&src, fname);
+	
+	if (hex_dump_middle) // -lm
+	{
+		offset -= line_num * 16;
+		line_num *= 2;
+		++line_num;
+		negative_line = false;
+	}
+	
+	if (negative_line) // -l -<line num>
+		offset -= line_num * 16;
+	
+	if (0 > offset)
+	{
+		fprintf(stderr, "Err: negative offset.\n");
+		exit(1);
+	}
+	
+	src_seek(&src, offset);
+	
+	out_open(&out, STDOUT_FILENO);
+	
+	print_dump_header(offset);
+	
+	// a short dump of a regular file reads only its own lines
+	if (line_num > 0 && line_num <= BLK_SIZE / MAX && (file_end = src_size(&src)) >= 0)
+	{
+		hex_window(&out, &src, offset, line_num, file_end);
+		out_close(&out);
+		src_close(&src);
+		return;
+	}
+	
+	// whole lines can be formatted by more than one thread
+	if (jobs > 1 && (file_end = src_size(&src)) > offset)
+	{
+		if (line_num > 0 && line_num < (file_end - offset) / MAX)
+			file_end = offset + line_num * MAX;
+		
+		lines_done = dump_parallel(&src, &out, file_end, false);
+	}
+
+	while (!is_n_eof && (n = src_next(&src, 0, &data)) > 0)
+	{	
+		for (k = 0; k < n; ) 
+		{
+			size_t lines = (n - k) / MAX;
+			
+			if (line_num > 0)
+			{
+				if (line_num == lines_done)
+				{
+					// don't print end characters if
+					is_n_eof = true;
+					break;
+				}
+				
+				if ((long long)lines > line_num - lines_done)
+					lines = line_num - lines_done;
+			}
+			
+			if (lines > 0)
+			{
+				if (lines > HEX_BATCH)
+					lines = HEX_BATCH;
+				
+				out.len += hex_lines(out_reserve(&out, lines * HEX_LN_LEN), data + k, lines);
+				k += lines * MAX;
+				lines_done += lines;
+				continue;
+			}
+			
+			// less than MAX bytes are left only at the eof
+			hex_tail(&out, data + k, n - k);
+			/* if the buffer fits perfectly we won't detect eof
+			 * in the current string and end marks won't be printed 
+			 * since !(len < MAX) */
+			is_n_eof = true;
+			++lines_done;
+			k = n;
+		}
+	}
+	
+		// print ending characters if n was never < MAX
+		if (!is_n_eof)
+			out_printf(&out, "%c%c\n", END, END);
+	
+	out_close(&out);
+	src_close(&src);
+}
+
+void hex_tail(OUT * out, const byte * buff, int len)
+{
+	// prints the last line of a dump, which is shorter than MAX, and the end marks
+	
+	LINE ln;
+	int i, j;
+	
+	for (i = 0, j = 0; i < len; ++i) // preapare hex string
+	{
+		ln.hxstr[j++] = (i % 4) ? ' ' : SPRT;	
+		ln.hxstr[j++] = HEXTBL[(buff[i] >> 4) & 0xF];
+		ln.hxstr[j++] = HEXTBL[buff[i] & 0xF];
+	}
+	
+	ln.hxstr[j++] = (i % 4) ? ' ' : SPRT;
+	// mark end of dump
+	ln.hxstr[j++] = END;
+	ln.hxstr[j++] = END;
+	ln.hxstr[j] = '\0';
+	
+	i = 0;	
+	ln.chstr[i] = SPRT;					
+	for (i = 1, j = 0; j < len; ++i, ++j)	// prepare the string section
+		ln.chstr[i] = !iscntrl(buff[j]) ? buff[j] : '.';
+		
+	ln.chstr[i] = '\0';
+	
+	// print the whole thing
+	out_printf(out, "%-*s%-*s\n", MAX*3, ln.hxstr, MAX, ln.chstr); 
+}
+
+void print_dump_header(off_t start)
+{
+	// print offset table and first byte offset to stderr
+	// so it won't get in the file if stdout is redirected
+	fprintf(stderr, " First byte offset: %#llx\n", (unsigned long long)start);
+	fprintf(stderr, "%s\n\n", OFFSET_TBL);
+}
+
+void hex_window(OUT * out, SRC * src, off_t start, long long lines, off_t file_end)
+{
+	/* dumps lines lines from start exactly like hex_dump() does, but reads
+	 * only those bytes, with pread() in blocks of BLK_SIZE, so nothing is
+	 * read ahead and the file position isn't used; a mapped file isn't read at all
+	 * the end marks are printed if the window reaches the eof */
+	
+	byte * buff = NULL;
+	off_t pos, end = file_end;
+	bool is_tail = false;
+	
+	if (start < file_end && lines <= (file_end - start) / MAX)
+		end = start + lines * MAX;
+	
+	for (pos = start; pos < end; ) 
+	{
+		size_t n = (end - pos < BLK_SIZE) ? end - pos : BLK_SIZE, k;
+		const byte * data;
+		
+		if (src->map)
+			data = src->map + pos;
+		else
+		{
+			if (!buff && !(buff = (byte *)malloc(n)) )
+			{
+				fprintf(stderr, "Err: unable to allocate read buffer.\n");
+				exit(1);
+			}
+			
+			if (src_pread(src, buff, n, pos) != n)
+			{
+				fprintf(stderr, "Err: read error.\n");
+				exit(1);
+			}
+			data = buff;
+		}
+		
+		for (k = 0; k + MAX <= n; ) 
+		{
+			size_t lines = (n - k) / MAX;
+			
+			if (lines > HEX_BATCH)
+				lines = HEX_BATCH;
+			
+			out->len += hex_lines(out_reserve(out, lines * HEX_LN_LEN), data + k, lines);
+			k += lines * MAX;
+		}
+		
+		// less than MAX bytes are left only at the eof
+		if (k < n)
+		{
+			hex_tail(out, data + k, n - k);
+			is_tail = true;
+		}
+		
+		pos += n;
+	}
+	
+	if (end >= file_end && !is_tail)
+		out_printf(out, "%c%c\n", END, END);
+	
+	free(buff);
+}
+
+void hex_windows(const char * fname, const char * list)
+{
+	/* dumps every window of list, which is off:lines,off:lines,...
+	 * off is in hex, lines is like -l: a negative count dumps the lines
+	 * before off, and m<n> dumps n lines before and after it like -lm
+	 * every window gets the header on stderr unless -wn was given */
+	
+	SRC src;
+	OUT out;
+	const char * p = list;
+	off_t file_end, start;
+	long long lines;
+	
+	// check them all first, so a bad one doesn't cut the dump short
+	while (*p)
+	{
+		if (!window_parse(&p, &start, &lines))
+		{
+			fprintf(stderr, "Err: bad window %s, use <offset>:<lines>.\n", p);
+			exit(1);
+		}
+		
+		if (0 > start)
+		{
+			fprintf(stderr, "Err: negative offset.\n");
+			exit(1);
+		}
+	}
+	
+	// a mapping would read ahead around every window, unless -m asks for it
+	if (!map_force)
+		map_never = true;
+	
+	src_open(&src, fname);
+	
+	if ((file_end = src_size(&src)) < 0)
+	{
+		fprintf(stderr, "Err: -%c needs a regular file.\n", WINDOW);
+		exit(1);
+	}
+	
+	out_open(&out, STDOUT_FILENO);
+	
+	for (p = list; *p; ) 
+	{
+		window_parse(&p, &start, &lines);
+		
+		// the header and the dump go to different streams, keep them in order
+		if (window_header)
+		{
+			out_flush(&out);
+			print_dump_header(start);
+		}
+		
+		hex_window(&out, &src, start, lines, file_end);
+	}
+	
+	out_close(&out);
+	src_close(&src);
+}
+
+bool window_parse(const char ** p, off_t * start, long long * lines)
+{
+	/* reads the off:lines window at *p into the first offset and the number
+	 * of lines to dump, and moves *p to the next window
+	 * returns false if the window is bad, *p stays on it then */
+	
+	char * end;
+	const char * q;
+	bool middle = false;
+	
+	*start = strtoll(*p, &end, 16);
+	if (':' != *end)
+		return false;
+	
+	q = end + 1;
+	if (MIDDLE == *q)
+	{
+		middle = true;
+		++q;
+	}
+	
+	*lines = strtoll(q, &end, 10);
+	if (0 == *lines || (middle && *lines < 0) || (',' != *end && '\0' != *end))
+		return false;
+	
+	if (middle)
+	{
+		*start -= *lines * MAX;
+		*lines = *lines * 2 + 1;
+	}
+	else if (*lines < 0)
+	{
+		*lines = -*lines;
+		*start -= *lines * MAX;
+	}
+	
+	*p = (',' == *end) ? end + 1 : end;
+	return true;
+}
+
+size_t hex_lines(char * out, const byte * data, size_t lines)
+{
+	/* formats lines full lines of MAX bytes from data into out
+	 * exactly like hex_dump() prints them and returns the number
+	 * of characters written, which is lines * HEX_LN_LEN */
+	
+#ifdef X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return hex_lines_avx2(out, data, lines);
+	if (__builtin_cpu_supports("ssse3"))
+		return hex_lines_ssse3(out, data, lines);
+	if (__builtin_cpu_supports("sse2"))
+		return hex_lines_sse2(out, data, lines);
+#endif
+	return hex_lines_scalar(out, data, lines);
+}
+
+size_t hex_lines_scalar(char * out, const byte * data, size_t lines)
+{
+	// hex_lines() for cpus without SIMD
+	
+	size_t ln;
+	
+	for (ln = 0; ln < lines; ++ln, data += MAX, out += HEX_LN_LEN) 
+	{
+		int i;
+		for (i = 0; i < MAX; ++i) 
+		{
+			out[i * 3] = (i % 4) ? ' ' : SPRT;
+			out[i * 3 + 1] = HEXTBL[(data[i] >> 4) & 0xF];
+			out[i * 3 + 2] = HEXTBL[data[i] & 0xF];
+			out[MAX * 3 + 1 + i] = !iscntrl(data[i]) ? data[i] : '.';
+		}
+		out[MAX * 3] = SPRT;
+		out[HEX_LN_LEN - 1] = '\n';
+	}
+	
+	return lines * HEX_LN_LEN;
+}
+
+#ifdef X86_SIMD
+/* all SIMD kernels do the same thing for 16 bytes at a time:
+ * the high and the low nibbles are turned into hex digits by adding '0',
+ * and 7 more for the ones above 9, then interleaved into digit pairs
+ * the char column is the input with control characters replaced by '.'
+ * the C locale iscntrl() is true for 0x00 - 0x1F and 0x7F */
+
+__attribute__((target("sse2")))
+static inline __m128i hex_digits(__m128i nibbles)
+{
+	// turns 16 values from 0 to 15 into hex digits
+	__m128i gt9 = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+	
+	nibbles = _mm_add_epi8(nibbles, _mm_set1_epi8('0'));
+	return _mm_add_epi8(nibbles, _mm_and_si128(gt9, _mm_set1_epi8('A' - '0' - 10)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i hex_chars(__m128i v)
+{
+	// the char column for 16 bytes
+	__m128i ctl = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v),
+	_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)));
+	
+	return _mm_or_si128(_mm_and_si128(ctl, _mm_set1_epi8('.')), _mm_andnot_si128(ctl, v));
+}
+
+__attribute__((target("sse2")))
+size_t hex_lines_sse2(char * out, const byte * data, size_t lines)
+{
+	// hex_lines() with SSE2 digits and scalar placement
+	
+	size_t ln;
+	char pairs[MAX * 2];
+	
+	for (ln = 0; ln < lines; ++ln, data += MAX, out += HEX_LN_LEN) 
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)data);
+		__m128i hi = hex_digits(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0xF)));
+		__m128i lo = hex_digits(_mm_and_si128(v, _mm_set1_epi8(0xF)));
+		int i;
+		
+		_mm_storeu_si128((__m128i *)pairs, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(pairs + MAX), _mm_unpackhi_epi8(hi, lo));
+		
+		for (i = 0; i < MAX; ++i) 
+		{
+			out[i * 3] = (i % 4) ? ' ' : SPRT;
+			out[i * 3 + 1] = pairs[i * 2];
+			out[i * 3 + 2] = pairs[i * 2 + 1];
+		}
+		
+		out[MAX * 3] = SPRT;
+		_mm_storeu_si128((__m128i *)(out + MAX * 3 + 1), hex_chars(v));
+		out[HEX_LN_LEN - 1] = '\n';
+	}
+	
+	return lines * HEX_LN_LEN;
+}
+
+/* the hex column is 48 characters, three vectors; every byte takes
+ * a separator and two digits, the digits are shuffled in place from
+ * the interleaved pairs of bytes 0 - 7 (p0) and 8 - 15 (p1)
+ * -128 zeroes the position, so the separator can be or-ed in */
+#define HEX_SHUF_0_P0 -128, 0, 1, -128, 2, 3, -128, 4, 5, -128, 6, 7, -128, 8, 9, -128
+#define HEX_SHUF_1_P0 10, 11, -128, 12, 13, -128, 14, 15, -128, -128, -128, -128, -128, -128, -128, -128
+#define HEX_SHUF_1_P1 -128, -128, -128, -128, -128, -128, -128, -128, -128, 0, 1, -128, 2, 3, -128, 4
+#define HEX_SHUF_2_P1 5, -128, 6, 7, -128, 8, 9, -128, 10, 11, -128, 12, 13, -128, 14, 15
+#define HEX_SEP_0 '|', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, '|', 0, 0, ' '
+#define HEX_SEP_1 0, 0, ' ', 0, 0, ' ', 0, 0, '|', 0, 0, ' ', 0, 0, ' ', 0
+#define HEX_SEP_2 0, ' ', 0, 0, '|', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0
+
+__attribute__((target("ssse3")))
+size_t hex_lines_ssse3(char * out, const byte * data, size_t lines)
+{
+	// hex_lines() with the whole line built in vector registers
+	
+	const __m128i shuf_0_p0 = _mm_setr_epi8(HEX_SHUF_0_P0);
+	const __m128i shuf_1_p0 = _mm_setr_epi8(HEX_SHUF_1_P0);
+	const __m128i shuf_1_p1 = _mm_setr_epi8(HEX_SHUF_1_P1);
+	const __m128i shuf_2_p1 = _mm_setr_epi8(HEX_SHUF_2_P1);
+	const __m128i sep_0 = _mm_setr_epi8(HEX_SEP_0);
+	const __m128i sep_1 = _mm_setr_epi8(HEX_SEP_1);
+	const __m128i sep_2 = _mm_setr_epi8(HEX_SEP_2);
+	size_t ln;
+	
+	for (ln = 0; ln < lines; ++ln, data += MAX, out += HEX_LN_LEN) 
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)data);
+		__m128i hi = hex_digits(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0xF)));
+		__m128i lo = hex_digits(_mm_and_si128(v, _mm_set1_epi8(0xF)));
+		__m128i p0 = _mm_unpacklo_epi8(hi, lo);
+		__m128i p1 = _mm_unpackhi_epi8(hi, lo);
+		
+		_mm_storeu_si128((__m128i *)out, _mm_or_si128(_mm_shuffle_epi8(p0, shuf_0_p0), sep_0));
+		_mm_storeu_si128((__m128i *)(out + 16), _mm_or_si128(_mm_or_si128(
+		_mm_shuffle_epi8(p0, shuf_1_p0), _mm_shuffle_epi8(p1, shuf_1_p1)), sep_1));
+		_mm_storeu_si128((__m128i *)(out + 32), _mm_or_si128(_mm_shuffle_epi8(p1, shuf_2_p1), sep_2));
+		
+		out[MAX * 3] = SPRT;
+		_mm_storeu_si128((__m128i *)(out + MAX * 3 + 1), hex_chars(v));
+		out[HEX_LN_LEN - 1] = '\n';
+	}
+	
+	return lines * HEX_LN_LEN;
+}
+
+__attribute__((target("avx2")))
+size_t hex_lines_avx2(char * out, const byte * data, size_t lines)
+{
+	/* hex_lines() for two lines at a time, one in each 128 bit lane
+	 * the shuffles work within a lane, so the ssse3 tables are reused */
+	
+	const __m256i shuf_0_p0 = _mm256_setr_epi8(HEX_SHUF_0_P0, HEX_SHUF_0_P0);
+	const __m256i shuf_1_p0 = _mm256_setr_epi8(HEX_SHUF_1_P0, HEX_SHUF_1_P0);
+	const __m256i shuf_1_p1 = _mm256_setr_epi8(HEX_SHUF_1_P1, HEX_SHUF_1_P1);
+	const __m256i shuf_2_p1 = _mm256_setr_epi8(HEX_SHUF_2_P1, HEX_SHUF_2_P1);
+	const __m256i sep_0 = _mm256_setr_epi8(HEX_SEP_0, HEX_SEP_0);
+	const __m256i sep_1 = _mm256_setr_epi8(HEX_SEP_1, HEX_SEP_1);
+	const __m256i sep_2 = _mm256_setr_epi8(HEX_SEP_2, HEX_SEP_2);
+	const __m256i low = _mm256_set1_epi8(0xF);
+	size_t ln;
+	
+	for (ln = 0; ln + 1 < lines; ln += 2, data += MAX * 2, out += HEX_LN_LEN * 2) 
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)data);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+		__m256i lo = _mm256_and_si256(v, low);
+		__m256i p0, p1, h0, h1, h2, ctl, chars;
+		
+		hi = _mm256_add_epi8(_mm256_add_epi8(hi, _mm256_set1_epi8('0')),
+		_mm256_and_si256(_mm256_cmpgt_epi8(hi, _mm256_set1_epi8(9)), _mm256_set1_epi8('A' - '0' - 10)));
+		lo = _mm256_add_epi8(_mm256_add_epi8(lo, _mm256_set1_epi8('0')),
+		_mm256_and_si256(_mm256_cmpgt_epi8(lo, _mm256_set1_epi8(9)), _mm256_set1_epi8('A' - '0' - 10)));
+		
+		p0 = _mm256_unpacklo_epi8(hi, lo);
+		p1 = _mm256_unpackhi_epi8(hi, lo);
+		h0 = _mm256_or_si256(_mm256_shuffle_epi8(p0, shuf_0_p0), sep_0);
+		h1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(p0, shuf_1_p0), 
+		_mm256_shuffle_epi8(p1, shuf_1_p1)), sep_1);
+		h2 = _mm256_or_si256(_mm256_shuffle_epi8(p1, shuf_2_p1), sep_2);
+		
+		ctl = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v),
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F)));
+		chars = _mm256_or_si256(_mm256_and_si256(ctl, _mm256_set1_epi8('.')), _mm256_andnot_si256(ctl, v));
+		
+		_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(h0));
+		_mm_storeu_si128((__m128i *)(out + 16), _mm256_castsi256_si128(h1));
+		_mm_storeu_si128((__m128i *)(out + 32), _mm256_castsi256_si128(h2));
+		out[MAX * 3] = SPRT;
+		_mm_storeu_si128((__m128i *)(out + MAX * 3 + 1), _mm256_castsi256_si128(chars));
+		out[HEX_LN_LEN - 1] = '\n';
+		
+		_mm_storeu_si128((__m128i *)(out + HEX_LN_LEN), _mm256_extracti128_si256(h0, 1));
+		_mm_storeu_si128((__m128i *)(out + HEX_LN_LEN + 16), _mm256_extracti128_si256(h1, 1));
+		_mm_storeu_si128((__m128i *)(out + HEX_LN_LEN + 32), _mm256_extracti128_si256(h2, 1));
+		out[HEX_LN_LEN + MAX * 3] = SPRT;
+		_mm_storeu_si128((__m128i *)(out + HEX_LN_LEN + MAX * 3 + 1), _mm256_extracti128_si256(chars, 1));
+		out[HEX_LN_LEN * 2 - 1] = '\n';
+	}
+	
+	// an odd line is left for ssse3
+	if (ln < lines)
+		hex_lines_ssse3(out, data, 1);
+	
+	return lines * HEX_LN_LEN;
+}
+#endif
+
+void diff_files(const char * fa, const char * fb)
+{
+	/* -d prints every line of MAX bytes which differs between fa and fb
+	 * side by side, then the changed ranges
+	 * equal blocks are skipped by diff_first() without being formatted,
+	 * the lines are aligned to MAX like a dump from offset 0 */
+	
+	SRC a, b;
+	OUT out;
+	DIFF_LIST diff = {NULL, 0, 0, 0LL};
+	byte * buff_a = NULL, * buff_b = NULL;
+	byte tail_a[MAX], tail_b[MAX];
+	off_t size_a, size_b, common, whole, pos;
+	int i;
+	
+	src_open(&a, fa);
+	src_open(&b, fb);
+	
+	if ((size_a = src_size(&a)) < 0 || (size_b = src_size(&b)) < 0)
+	{
+		fprintf(stderr, "Err: -%c needs regular files.\n", DIFF);
+		exit(1);
+	}
+	
+	if ((!a.map && !(buff_a = (byte *)malloc(BLK_SIZE))) || (!b.map && !(buff_b = (byte *)malloc(BLK_SIZE))))
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	common = (size_a < size_b) ? size_a : size_b;
+	whole = common - common % MAX;
+	
+	out_open(&out, STDOUT_FILENO);
+	
+	// to stderr like print_dump_header()
+	fprintf(stderr, "%*s%-*s  %s\n", DIFF_OFF_LEN, "", HEX_LN_LEN - 1, fa, fb);
+	fprintf(stderr, "%*s%-*s  %s\n\n", DIFF_OFF_LEN, "", HEX_LN_LEN - 1, OFFSET_TBL, OFFSET_TBL);
+	
+	for (pos = 0; pos < whole; pos += BLK_SIZE) 
+	{
+		size_t n = (whole - pos < BLK_SIZE) ? whole - pos : BLK_SIZE, k = 0;
+		const byte * da = a.map ? a.map + pos : buff_a;
+		const byte * db = b.map ? b.map + pos : buff_b;
+		
+		if ((!a.map && src_pread(&a, buff_a, n, pos) != n) || (!b.map && src_pread(&b, buff_b, n, pos) != n))
+		{
+			fprintf(stderr, "Err: read error.\n");
+			exit(1);
+		}
+		
+		while ((k += diff_first(da + k, db + k, n - k)) < n)
+		{
+			// n is whole lines, the changed ones are printed up to the next equal one
+			for (k -= k % MAX; k < n; k += MAX) 
+			{
+				unsigned mask = diff_mask(da + k, db + k, MAX);
+				
+				if (!mask)
+					break;
+				
+				diff_line(&out, &diff, pos + k, da + k, MAX, db + k, MAX, mask);
+			}
+		}
+	}
+	
+	// the last line may be shorter on one side or on both
+	if (whole < size_a || whole < size_b)
+	{
+		int len_a = src_pread(&a, tail_a, MAX, whole), len_b = src_pread(&b, tail_b, MAX, whole);
+		int len = (len_a < len_b) ? len_a : len_b;
+		unsigned mask = diff_mask(tail_a, tail_b, len);
+		
+		for (i = len; i < len_a || i < len_b; ++i) 
+			mask |= 1u << i;
+		
+		if (mask)
+			diff_line(&out, &diff, whole, tail_a, len_a, tail_b, len_b, mask);
+	}
+	
+	// the rest of the longer file isn't printed, it's one range
+	if (size_a != size_b && whole + MAX < ((size_a > size_b) ? size_a : size_b))
+		diff_add(&diff, whole + MAX, ((size_a > size_b) ? size_a : size_b) - (whole + MAX));
+	
+	if (0 == diff.count)
+		out_printf(&out, "Files are identical.\n");
+	else
+	{
+		out_printf(&out, "\n%lld byte%s differ%s in %d range%s:\n", diff.bytes, (1 == diff.bytes) ? "" : "s", 
+		(1 == diff.bytes) ? "s" : "", diff.count, (1 == diff.count) ? "" : "s");
+		
+		for (i = 0; i < diff.count; ++i) 
+		{
+			long long len = diff.ranges[i].end - diff.ranges[i].start;
+			
+			out_printf(&out, "%#llx - %#llx, %lld byte%s\n", (unsigned long long)diff.ranges[i].start, 
+			(unsigned long long)(diff.ranges[i].end - 1), len, (1 == len) ? "" : "s");
+		}
+		
+		if (size_a != size_b)
+			out_printf(&out, "%s is %lld bytes longer.\n", (size_a > size_b) ? fa : fb, 
+			(long long)((size_a > size_b) ? size_a - size_b : size_b - size_a));
+	}
+	
+	out_close(&out);
+	free(diff.ranges);
+	free(buff_a);
+	free(buff_b);
+	src_close(&a);
+	src_close(&b);
+}
+
+void diff_line(OUT * out, DIFF_LIST * diff, off_t off, const byte * da, int len_a, const byte * db, int len_b, unsigned mask)
+{
+	// prints the line at off of both files and adds the bytes set in mask to the ranges
+	char * ln;
+	
+	for (; mask; mask &= mask - 1) 
+		diff_add(diff, off + __builtin_ctz(mask), 1);
+	
+	out_printf(out, "%#*llx ", DIFF_OFF_LEN - 1, (unsigned long long)off);
+	
+	ln = out_reserve(out, (HEX_LN_LEN - 1) * 2 + 3);
+	diff_side(ln, da, len_a);
+	ln[HEX_LN_LEN - 1] = ' ';
+	ln[HEX_LN_LEN] = ' ';
+	diff_side(ln + HEX_LN_LEN + 1, db, len_b);
+	ln[(HEX_LN_LEN - 1) * 2 + 2] = '\n';
+	out->len += (HEX_LN_LEN - 1) * 2 + 3;
+}
+
+void diff_side(char * out, const byte * data, int len)
+{
+	// formats len bytes as a dump line without the new line, padded to a full one
+	int i;
+	
+	if (MAX == len)
+	{
+		char ln[HEX_LN_LEN];
+		
+		hex_lines(ln, data, 1);
+		memcpy(out, ln, HEX_LN_LEN - 1);
+		return;
+	}
+	
+	memset(out, ' ', HEX_LN_LEN - 1);
+	for (i = 0; i < len; ++i) 
+	{
+		out[i * 3] = (i % 4) ? ' ' : SPRT;
+		out[i * 3 + 1] = HEXTBL[(data[i] >> 4) & 0xF];
+		out[i * 3 + 2] = HEXTBL[data[i] & 0xF];
+		out[MAX * 3 + 1 + i] = !iscntrl(data[i]) ? data[i] : '.';
+	}
+	out[i * 3] = SPRT;
+	out[MAX * 3] = SPRT;
+}
+
+void diff_add(DIFF_LIST * diff, off_t pos, off_t len)
+{
+	// adds len changed bytes from pos, a range less than a line after the last one joins it
+	DIFF_RANGE * last = diff->count ? &diff->ranges[diff->count - 1] : NULL;
+	
+	diff->bytes += len;
+	
+	if (last && pos - last->end < MAX)
+	{
+		last->end = pos + len;
+		return;
+	}
+	
+	if (diff->count == diff->cap)
+	{
+		diff->cap = diff->cap ? diff->cap * 2 : 64;
+		if ( !(diff->ranges = (DIFF_RANGE *)realloc(diff->ranges, diff->cap * sizeof(DIFF_RANGE))) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+	}
+	
+	diff->ranges[diff->count].start = pos;
+	diff->ranges[diff->count++].end = pos + len;
+}
+
+unsigned diff_mask(const byte * a, const byte * b, int len)
+{
+	// returns a bit for every one of the len bytes, up to MAX, which differs
+	unsigned mask = 0;
+	int i;
+	
+	for (i = 0; i < len; ++i) 
+		mask |= (unsigned)(a[i] != b[i]) << i;
+	
+	return mask;
+}
+
+size_t diff_first(const byte * a, const byte * b, size_t len)
+{
+	// returns the offset of the first byte which differs, len if none does
+#ifdef X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		return diff_first_avx2(a, b, len);
+	if (__builtin_cpu_supports("sse2"))
+		return diff_first_sse2(a, b, len);
+#endif
+	return diff_first_scalar(a, b, len, 0);
+}
+
+size_t diff_first_scalar(const byte * a, const byte * b, size_t len, size_t i)
+{
+	// diff_first() 8 bytes at a time from i, the SIMD kernels finish with it
+	uint64_t wa, wb;
+	
+	for (; i + 8 <= len; i += 8) 
+	{
+		memcpy(&wa, a + i, 8);
+		memcpy(&wb, b + i, 8);
+		if (wa != wb)
+			break;
+	}
+	
+	for (; i < len && a[i] == b[i]; ++i) 
+		continue;
+	
+	return i;
+}
+
+#ifdef X86_SIMD
+__attribute__((target("sse2")))
+size_t diff_first_sse2(const byte * a, const byte * b, size_t len)
+{
+	// diff_first() 16 bytes at a time
+	size_t i;
+	
+	for (i = 0; i + 16 <= len; i += 16) 
+	{
+		__m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+		unsigned mask = ~_mm_movemask_epi8(eq) & 0xFFFF;
+		
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	
+	return diff_first_scalar(a, b, len, i);
+}
+
+__attribute__((target("avx2")))
+size_t diff_first_avx2(const byte * a, const byte * b, size_t len)
+{
+	// diff_first() 64 bytes at a time, two loads of each side per test
+	size_t i;
+	
+	for (i = 0; i + 64 <= len; i += 64) 
+	{
+		__m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+		__m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 32)), 
+		_mm256_loadu_si256((const __m256i *)(b + i + 32)));
+		
+		if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) != 0xFFFFFFFFu)
+		{
+			uint64_t mask = ~(((uint64_t)(unsigned)_mm256_movemask_epi8(eq1) << 32) | (unsigned)_mm256_movemask_epi8(eq0));
+			return i + __builtin_ctzll(mask);
+		}
+	}
+	
+	return diff_first_scalar(a, b, len, i);
+}
+#endif
+
+void search(const char mode, const char * fname, const char * sequence)
+{
+	// string and byte sequence search
+	
+	// only -sa -su -sb -sp -sf are accepted
+	if (BIN != mode && ASCII != mode && UNICODE != mode && PATTERN != mode && SIG_FILE != mode)
+	{
+		fprintf(stderr, "Err: invalid search mode.\n");
+		exit(1);
+	}
+	
+	// patterns and pattern files have scanners of their own
+	if (PATTERN == mode)
+	{
+		pat_search(fname, sequence);
+		return;
+	}
+	
+	if (SIG_FILE == mode)
+	{
+		sig_search(fname, sequence);
+		return;
+	}
+	
+	if (UNICODE == mode && ENC_ALL == encoding)
+	{
+		enc_search(fname, sequence);
+		return;
+	}
+	
+	SRC src;
+	SRCH_PAT pat;
+	IDX idx;
+	PATCH patch;
+	PATCH * re_patch = NULL;
+	const byte * data;
+	size_t n, carry = 0;
+	off_t base, file_end;
+	unsigned long long matches_found = 0;
+	
+	srch_pat_init(&pat, mode, sequence);
+	
+	src_open(&src, fname);
+	base = src.pos;
+	
+	/* with -re every match goes in the patch, which writes
+	 * only the bytes the search has already left behind */
+	if (replace_everything)
+	{
+		patch_open(&patch, mode, fname, replace_only_seq);
+		re_patch = &patch;
+	}
+	
+	// a plain search of an indexed file scans only the blocks the index points to
+	if (!replace_everything && !idx_never && (file_end = src_size(&src)) >= 0 && idx_load(&idx, fname, &src))
+	{
+		bool done = idx_search(&idx, &pat, &src, file_end, &matches_found);
+		
+		idx_free(&idx);
+		if (done)
+			goto matches_and_go;
+	}
+	
+	// -j splits regular files between threads
+	if (jobs > 1 && (file_end = src_size(&src)) >= 0)
+	{
+		matches_found = srch_parallel(&pat, &src, file_end, re_patch);
+		goto matches_and_go;
+	}
+	
+	// every block starts with the bytes the previous one couldn't check
+	while ( (n = src_next(&src, carry, &data)) > 0 )
+	{
+		size_t pos = 0;
+		
+		while (srch_scan(&pat, data, n, &pos))
+		{
+			srch_report(base + pos, re_patch);
+			++matches_found;
+			
+			// step just one byte so we won't skip recurring patterns
+			++pos;
+		}
+		
+		// keep the bytes which still could be the start of a match
+		carry = n - pos;
+		base += pos;
+	}
+	
+	matches_and_go:
+		if (replace_everything)
+			patch_close(&patch);
+		
+		// print number of matches found
+		fprintf(stdout, "%llu %s found.\n", matches_found, (matches_found != 1) ? "matches" : "match");
+		
+		if (replace_everything) // print number of replaced matches
+			fprintf(stdout, "%llu %s replaced.\n", matches_found, (matches_found != 1) ? "matches" : "match");
+	
+	srch_pat_free(&pat);
+	src_close(&src);
+}
+
+void srch_report(off_t pos, PATCH * patch)
+{
+	// prints a match offset and replaces the match if there's a patch
+	fprintf(stdout, "Match found at: %#llx\n", (unsigned long long)pos);
+	
+	if (patch)
+	{
+		patch_add(patch, pos);
+		fprintf(stdout, "Match replaced.\n");
+	}
+}
+
+unsigned long long srch_parallel(const SRCH_PAT * pat, SRC * src, off_t file_end, PATCH * patch)
+{
+	/* splits the file from src->pos into PAR_CHUNK long chunks and searches
+	 * up to jobs of them at a time, each chunk in its own thread
+	 * every chunk reads len - 1 bytes past its end, so matches which
+	 * cross the border are found as well, but only by the chunk they start in
+	 * the matches are printed chunk by chunk in ascending order, and the
+	 * patch writes only behind them, so it never touches the next round
+	 * returns the number of matches */
+	
+	SRCH_JOB job_arr[MAX_JOBS];
+	unsigned long long matches_found = 0;
+	off_t start = src->pos;
+	int i, n;
+	
+	for (i = 0; i < jobs; ++i) 
+	{
+		job_arr[i].pat = pat;
+		job_arr[i].src = src;
+		job_arr[i].file_end = file_end;
+		job_arr[i].buff = NULL;
+		job_arr[i].matches = NULL;
+		job_arr[i].cap = 0;
+	}
+	
+	while (start < file_end)
+	{
+		for (n = 0; n < jobs && start < file_end; ++n, start += PAR_CHUNK) 
+		{
+			job_arr[n].start = start;
+			job_arr[n].end = (file_end - start > PAR_CHUNK) ? start + PAR_CHUNK : file_end;
+		}
+		
+		run_jobs(srch_job, job_arr, sizeof(SRCH_JOB), n);
+		
+		for (i = 0; i < n; ++i) 
+		{
+			size_t j;
+			for (j = 0; j < job_arr[i].count; ++j) 
+				srch_report(job_arr[i].start + job_arr[i].matches[j], patch);
+			matches_found += job_arr[i].count;
+		}
+	}
+	
+	for (i = 0; i < jobs; ++i) 
+	{
+		free(job_arr[i].buff);
+		free(job_arr[i].matches);
+	}
+	
+	return matches_found;
+}
+
+void * srch_job(void * arg)
+{
+	// searches one chunk for srch_parallel()
+	
+	SRCH_JOB * job = (SRCH_JOB *)arg;
+	const byte * data;
+	size_t n, pos = 0;
+	off_t stop = job->end + job->pat->len - 1;
+	
+	if (stop > job->file_end)
+		stop = job->file_end;
+	
+	n = stop - job->start;
+	
+	if (job->src->map)
+		data = job->src->map + job->start;
+	else
+	{
+		if (!job->buff && !(job->buff = (byte *)malloc(PAR_CHUNK + job->pat->len)) )
+		{
+			fprintf(stderr, "Err: unable to allocate search buffer.\n");
+			exit(1);
+		}
+		
+		n = src_pread(job->src, job->buff, n, job->start);
+		data = job->buff;
+	}
+	
+	job->count = 0;
+	while (srch_scan(job->pat, data, n, &pos))
+	{
+		if (job->count == job->cap)
+		{
+			job->cap = job->cap ? job->cap * 2 : 1024;
+			if ( !(job->matches = (uint32_t *)realloc(job->matches, job->cap * sizeof(uint32_t))) )
+			{
+				fprintf(stderr, "Err: unable to allocate match buffer.\n");
+				exit(1);
+			}
+		}
+		
+		job->matches[job->count++] = pos;
+		++pos;
+	}
+	
+	return NULL;
+}
+
+void run_jobs(void * (*job_fn)(void *), void * job_arr, size_t job_size, int n)
+{
+	/* runs job_fn on each of the n structs in job_arr in its own thread
+	 * and waits for all of them to finish */
+	
+	pthread_t tid[MAX_JOBS];
+	int i;
+	
+	if (1 == n)
+	{
+		job_fn(job_arr);
+		return;
+	}
+	
+	for (i = 0; i < n; ++i) 
+	{
+		if (pthread_create(&tid[i], NULL, job_fn, (byte *)job_arr + i * job_size) != 0)
+		{
+			fprintf(stderr, "Err: unable to start a thread.\n");
+			exit(1);
+		}
+	}
+	
+	for (i = 0; i < n; ++i) 
+		pthread_join(tid[i], NULL);
+}
+
+void srch_pat_init(SRCH_PAT * pat, const char mode, const char * sequence)
+{
+	/* prepares sequence for srch_scan() according to the search mode
+	 * Unicode strings are encoded once, so they're matched like bytes
+	 * with -sai and -sui the letters are folded to lower case, see srch_fold() */
+	
+	int i, len;
+	
+	pat->fold = NULL;
+	pat->seq = seq_to_bytes(mode, sequence, &len);
+	
+	if (0 == len)
+	{
+		fprintf(stderr, "Err: empty search sequence.\n");
+		exit(1);
+	}
+	
+	pat->len = len;
+	
+	// a byte which is not in the sequence lets the window jump its whole length
+	for (i = 0; i < 256; ++i) 
+		pat->skip[i] = len;
+	
+	if (no_case)
+		srch_fold(pat, mode);
+	
+	for (i = 0; i < len - 1; ++i) 
+	{
+		pat->skip[pat->seq[i]] = len - 1 - i;
+		if (pat->fold)
+			pat->skip[pat->seq[i] & ~pat->fold[i]] = len - 1 - i;
+	}
+}
+
+void srch_fold(SRCH_PAT * pat, const char mode)
+{
+	/* marks in pat->fold with 0x20 every byte of the sequence which is
+	 * an ASCII letter on its own, and not part of a wider character,
+	 * and makes it lower case; a window byte matches such a byte
+	 * when it's the same after OR-ing it with 0x20 */
+	
+	int i;
+	
+	if ( !(pat->fold = (byte *)calloc(pat->len, 1)) )
+	{
+		fprintf(stderr, "Err: unable to allocate byte buffer.\n");
+		exit(1);
+	}
+	
+	for (i = 0; i < pat->len; ++i) 
+	{
+		bool letter = isalpha(pat->seq[i]);
+		
+		// an UTF-16 character is an ASCII one when its other byte is 0
+		if (UNICODE == mode && ENC_LE == encoding)
+			letter = letter && !(i % 2) && 0 == pat->seq[i + 1];
+		else if (UNICODE == mode && ENC_BE == encoding)
+			letter = letter && (i % 2) && 0 == pat->seq[i - 1];
+		
+		if (letter)
+		{
+			pat->fold[i] = 0x20;
+			pat->seq[i] |= 0x20;
+		}
+	}
+}
+
+void srch_pat_free(SRCH_PAT * pat)
+{
+	// releases the buffers from srch_pat_init()
+	free(pat->seq);
+	free(pat->fold);
+}
+
+bool srch_scan(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos)
+{
+	/* looks for the next match in data starting from *pos
+	 * returns true and leaves the match position in *pos, or returns false
+	 * and leaves in *pos the first position which couldn't be checked
+	 * because less than pat->len bytes were left in data */
+	
+	size_t p = *pos;
+	size_t m = pat->len;
+	
+	if (pat->fold)
+		return srch_scan_fold(pat, data, len, pos);
+	
+	if (1 == m) // memchr() is faster for single bytes
+	{
+		const byte * found;
+		
+		if (p < len && (found = memchr(data + p, pat->seq[0], len - p)))
+		{
+			*pos = found - data;
+			return true;
+		}
+		
+		*pos = len;
+		return false;
+	}
+	
+	while (p + m <= len)
+	{
+		const byte * win = data + p;
+		byte last = win[m - 1];
+		
+		if (last == pat->seq[m - 1] && 0 == memcmp(win, pat->seq, m - 1))
+		{
+			*pos = p;
+			return true;
+		}
+		
+		p += pat->skip[last];
+	}
+	
+	*pos = p;
+	return false;
+}
+
+static inline bool fold_eq(const SRCH_PAT * pat, const byte * win)
+{
+	// compares a window with a case folded sequence
+	int i;
+	
+	for (i = 0; i < pat->len; ++i) 
+	{
+		if ((win[i] | pat->fold[i]) != pat->seq[i])
+			return false;
+	}
+	
+	return true;
+}
+
+bool srch_scan_fold(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos)
+{
+	/* srch_scan() for -sai and -sui
+	 * the SIMD kernels go over the bulk of data, the rest is left
+	 * to Boyer-Moore-Horspool, whose shifts are set for both cases */
+	
+	size_t p, m = pat->len;
+	
+#ifdef X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+	{
+		if (srch_fold_avx2(pat, data, len, pos))
+			return true;
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		if (srch_fold_sse2(pat, data, len, pos))
+			return true;
+	}
+#endif
+	
+	for (p = *pos; p + m <= len; p += pat->skip[data[p + m - 1]]) 
+	{
+		if (fold_eq(pat, data + p))
+		{
+			*pos = p;
+			return true;
+		}
+	}
+	
+	*pos = p;
+	return false;
+}
+
+#ifdef X86_SIMD
+/* the kernels check the first and the last byte of the sequence against
+ * 16 or 32 windows at once: both loads are OR-ed with their fold masks,
+ * compared with the folded bytes, and every window passing both is verified
+ * like the scalar code does; on a miss *pos is the first unchecked window */
+
+__attribute__((target("sse2")))
+bool srch_fold_sse2(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos)
+{
+	// srch_scan_fold() 16 windows at a time
+	size_t p = *pos, m = pat->len;
+	__m128i f0 = _mm_set1_epi8(pat->fold[0]), fl = _mm_set1_epi8(pat->fold[m - 1]);
+	__m128i c0 = _mm_set1_epi8(pat->seq[0]), cl = _mm_set1_epi8(pat->seq[m - 1]);
+	
+	for (; p + 16 + m - 1 <= len; p += 16) 
+	{
+		__m128i first = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + p)), f0);
+		__m128i last = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + p + m - 1)), fl);
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, c0), _mm_cmpeq_epi8(last, cl)));
+		
+		for (; mask; mask &= mask - 1) 
+		{
+			size_t w = p + __builtin_ctz(mask);
+			if (fold_eq(pat, data + w))
+			{
+				*pos = w;
+				return true;
+			}
+		}
+	}
+	
+	*pos = p;
+	return false;
+}
+
+__attribute__((target("avx2")))
+bool srch_fold_avx2(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos)
+{
+	// srch_scan_fold() 32 windows at a time
+	size_t p = *pos, m = pat->len;
+	__m256i f0 = _mm256_set1_epi8(pat->fold[0]), fl = _mm256_set1_epi8(pat->fold[m - 1]);
+	__m256i c0 = _mm256_set1_epi8(pat->seq[0]), cl = _mm256_set1_epi8(pat->seq[m - 1]);
+	
+	for (; p + 32 + m - 1 <= len; p += 32) 
+	{
+		__m256i first = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + p)), f0);
+		__m256i last = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + p + m - 1)), fl);
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, c0), _mm256_cmpeq_epi8(last, cl)));
+		
+		for (; mask; mask &= mask - 1) 
+		{
+			size_t w = p + __builtin_ctz(mask);
+			if (fold_eq(pat, data + w))
+			{
+				*pos = w;
+				return true;
+			}
+		}
+	}
+	
+	*pos = p;
+	return false;
+}
+#endif
+
+static inline uint32_t idx_hash(const byte * gram)
+{
+	// hashes the 4 bytes at gram to a posting list
+	uint32_t g;
+	
+	memcpy(&g, gram, sizeof(g));
+	return (g * 2654435761u) >> (32 - IDX_BITS);
+}
+
+char * side_name(const char * fname, const char * ext)
+{
+	// returns the malloc()-ed name of the ext file next to fname, like the index
+	char * name;
+	
+	if ( !(name = (char *)malloc(strlen(fname) + strlen(ext) + 1)) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	strcpy(name, fname);
+	strcat(name, ext);
+	return name;
+}
+
+void idx_build(const char * fname)
+{
+	/* writes the search index of fname to fname.thx
+	 * for every IDX_BLK block of the file, the hashes of the 4 byte grams
+	 * starting in it are listed, unless there are more than IDX_DENSE of them
+	 * then the block is only marked as dense and always gets scanned
+	 * the index is only good while the size and mtime of fname don't change */
+	
+	SRC src;
+	IDX_HDR hdr;
+	IDX_LIST * lists;
+	FILE * fpout;
+	struct stat st;
+	const byte * data;
+	uint64_t * dense, * seen, words, blk = 0, dense_count = 0, post = 0;
+	uint32_t * grams;
+	size_t n, count = 0, carry = 0, i;
+	off_t base = 0, blk_end = IDX_BLK;
+	char * name;
+	
+	if (is_std(fname))
+	{
+		fprintf(stderr, "Err: stdin can't be indexed.\n");
+		exit(1);
+	}
+	
+	src_open(&src, fname);
+	if (fstat(fileno(src.fp), &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		fprintf(stderr, "Err: only regular files can be indexed.\n");
+		exit(1);
+	}
+	
+	// the index always covers the whole file
+	src_seek(&src, 0);
+	
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.size = st.st_size;
+	hdr.mtime_sec = st.st_mtim.tv_sec;
+	hdr.mtime_nsec = st.st_mtim.tv_nsec;
+	hdr.blk_size = IDX_BLK;
+	hdr.bits = IDX_BITS;
+	hdr.blocks = (hdr.size + IDX_BLK - 1) / IDX_BLK;
+	words = (hdr.blocks + 63) / 64;
+	
+	dense = (uint64_t *)calloc(words + 1, sizeof(uint64_t));
+	seen = (uint64_t *)calloc((1 << IDX_BITS) / 64, sizeof(uint64_t));
+	grams = (uint32_t *)malloc(IDX_BLK * sizeof(uint32_t));
+	lists = (IDX_LIST *)calloc(1 << IDX_BITS, sizeof(IDX_LIST));
+	
+	if (!dense || !seen || !grams || !lists)
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	// every block keeps the 3 bytes the last gram of the previous one needs
+	while ( (n = src_next(&src, carry, &data)) > 0 )
+	{
+		for (i = 0; i + 4 <= n; ++i) 
+		{
+			uint32_t h;
+			
+			if (base + (off_t)i >= blk_end)
+			{
+				idx_add_blk(lists, dense, seen, grams, count, blk);
+				count = 0;
+				++blk;
+				blk_end += IDX_BLK;
+			}
+			
+			h = idx_hash(data + i);
+			if ( !(seen[h >> 6] & (1ULL << (h & 63))) )
+			{
+				seen[h >> 6] |= 1ULL << (h & 63);
+				grams[count++] = h;
+			}
+		}
+		
+		carry = n - i;
+		base += i;
+	}
+	
+	if (count > 0)
+		idx_add_blk(lists, dense, seen, grams, count, blk);
+	
+	src_close(&src);
+	
+	name = side_name(fname, IDX_EXT);
+	fpout = open_file(name, "wb");
+	
+	// the magic goes in last, so a half written index is never used
+	fwrite(&hdr, sizeof(hdr), 1, fpout);
+	fwrite(dense, sizeof(uint64_t), words, fpout);
+	
+	for (i = 0; i < (1 << IDX_BITS); ++i) 
+	{
+		fwrite(&post, sizeof(post), 1, fpout);
+		post += lists[i].len;
+	}
+	fwrite(&post, sizeof(post), 1, fpout);
+	
+	for (i = 0; i < (1 << IDX_BITS); ++i) 
+	{
+		fwrite(lists[i].buff, sizeof(byte), lists[i].len, fpout);
+		free(lists[i].buff);
+	}
+	
+	for (i = 0; i < words; ++i) 
+		dense_count += __builtin_popcountll(dense[i]);
+	
+	memcpy(hdr.magic, IDX_MAGIC, sizeof(hdr.magic));
+	fseeko(fpout, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, fpout);
+	
+	if (ferror(fpout) || fclose(fpout) != 0)
+	{
+		fprintf(stderr, "Err: write error. Writing to %s has failed.\n", name);
+		remove(name);
+		exit(1);
+	}
+	
+	fprintf(stdout, "Index written to %s.\n", name);
+	fprintf(stdout, "%llu blocks, %llu dense, %llu bytes of postings.\n", (unsigned long long)hdr.blocks, 
+	(unsigned long long)dense_count, (unsigned long long)post);
+	
+	free(name);
+	free(lists);
+	free(grams);
+	free(seen);
+	free(dense);
+}
+
+void idx_add_blk(IDX_LIST * lists, uint64_t * dense, uint64_t * seen, const uint32_t * grams, size_t count, uint64_t blk)
+{
+	// lists blk in the posting list of every gram in it, or marks it dense
+	size_t i;
+	
+	for (i = 0; i < count; ++i) 
+		seen[grams[i] >> 6] &= ~(1ULL << (grams[i] & 63));
+	
+	if (count > IDX_DENSE)
+	{
+		dense[blk / 64] |= 1ULL << (blk % 64);
+		return;
+	}
+	
+	for (i = 0; i < count; ++i) 
+	{
+		IDX_LIST * l = lists + grams[i];
+		uint64_t delta = blk - l->last;
+		
+		if (l->len + 10 > l->cap)
+		{
+			l->cap = l->cap ? l->cap * 2 : 16;
+			if ( !(l->buff = (byte *)realloc(l->buff, l->cap)) )
+			{
+				fprintf(stderr, "Err: memory allocation failed.\n");
+				exit(1);
+			}
+		}
+		
+		// 7 bits at a time, the high bit says there's more
+		while (delta >= 0x80)
+		{
+			l->buff[l->len++] = (byte)(delta | 0x80);
+			delta >>= 7;
+		}
+		l->buff[l->len++] = (byte)delta;
+		l->last = blk;
+	}
+}
+
+bool idx_load(IDX * idx, const char * fname, SRC * src)
+{
+	/* maps the index of fname if there is one and it still matches
+	 * the file, a stale index is ignored with a note */
+	
+	struct stat st, ist;
+	FILE * fp;
+	char * name;
+	void * map;
+	uint64_t words;
+	
+	if (is_std(fname) || fstat(fileno(src->fp), &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+	
+	name = side_name(fname, IDX_EXT);
+	fp = fopen(name, "rb");
+	
+	if (!fp)
+	{
+		free(name);
+		return false;
+	}
+	
+	idx->map = NULL;
+	idx->map_len = 0;
+	
+	if (fstat(fileno(fp), &ist) == 0 && (size_t)ist.st_size >= sizeof(IDX_HDR) && 
+	MAP_FAILED != (map = mmap(NULL, ist.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0)))
+	{
+		idx->map = (const byte *)map;
+		idx->map_len = ist.st_size;
+	}
+	fclose(fp);
+	
+	if (!idx->map)
+	{
+		free(name);
+		return false;
+	}
+	
+	idx->hdr = (const IDX_HDR *)idx->map;
+	words = (idx->hdr->blocks + 63) / 64;
+	
+	if (memcmp(idx->hdr->magic, IDX_MAGIC, sizeof(idx->hdr->magic)) != 0 || IDX_BLK != idx->hdr->blk_size ||
+	IDX_BITS != idx->hdr->bits || idx->map_len < sizeof(IDX_HDR) + (words + (1 << IDX_BITS) + 1) * sizeof(uint64_t))
+	{
+		fprintf(stderr, "Note: %s isn't a valid index, searching without it.\n", name);
+		goto no_idx;
+	}
+	
+	if (idx->hdr->size != (uint64_t)st.st_size || idx->hdr->mtime_sec != st.st_mtim.tv_sec ||
+	idx->hdr->mtime_nsec != st.st_mtim.tv_nsec)
+	{
+		fprintf(stderr, "Note: %s is out of date, searching without it.\n", name);
+		goto no_idx;
+	}
+	
+	idx->dense = (const uint64_t *)(idx->map + sizeof(IDX_HDR));
+	idx->dir = idx->dense + words;
+	idx->post = (const byte *)(idx->dir + (1 << IDX_BITS) + 1);
+	
+	if (idx->dir[1 << IDX_BITS] > idx->map_len - (idx->post - idx->map))
+	{
+		fprintf(stderr, "Note: %s isn't a valid index, searching without it.\n", name);
+		goto no_idx;
+	}
+	
+	free(name);
+	return true;
+	
+	no_idx:
+		idx_free(idx);
+		free(name);
+		return false;
+}
+
+void idx_free(IDX * idx)
+{
+	// unmaps what idx_load() mapped
+	munmap((void *)idx->map, idx->map_len);
+	idx->map = NULL;
+}
+
+bool idx_search(const IDX * idx, const SRCH_PAT * pat, SRC * src, off_t file_end, unsigned long long * matches_found)
+{
+	/* searches only the blocks the index can't rule out
+	 * a match starting in block b has each of its grams starting in b or b + 1,
+	 * so b is a candidate if every picked gram is listed, or dense, in b or b + 1
+	 * returns false if the pattern is shorter than one 4 byte gram */
+	
+	int ks[IDX_GRAMS], nk, picked = 0, i;
+	uint64_t words = (idx->hdr->blocks + 63) / 64, * cand, * hit, b;
+	byte * buff = NULL;
+	
+	// the index holds the bytes as they are, not folded
+	if (pat->len > IDX_BLK || pat->fold)
+		return false;
+	
+	nk = pat->len - 3; // grams in the pattern
+	if (nk <= 0)
+		return false;
+	
+	// up to IDX_GRAMS of them spread over the pattern
+	for (i = 0; i < nk && picked < IDX_GRAMS; ++i) 
+	{
+		if (i == ((nk <= IDX_GRAMS) ? picked : picked * (nk - 1) / (IDX_GRAMS - 1)))
+			ks[picked++] = i;
+	}
+	
+	cand = (uint64_t *)malloc((words + 1) * sizeof(uint64_t));
+	hit = (uint64_t *)malloc((words + 1) * sizeof(uint64_t));
+	if (!cand || !hit)
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	memset(cand, 0xFF, words * sizeof(uint64_t));
+	cand[words] = 0;
+	
+	for (i = 0; i < picked; ++i) 
+	{
+		uint32_t h = idx_hash(pat->seq + ks[i]);
+		const byte * p = idx->post + idx->dir[h], * end = idx->post + idx->dir[h + 1];
+		uint64_t w;
+		
+		memcpy(hit, idx->dense, words * sizeof(uint64_t));
+		hit[words] = 0;
+		
+		for (b = 0; p < end; ) 
+		{
+			uint64_t delta = 0;
+			int shift = 0;
+			
+			while (p < end && (*p & 0x80))
+			{
+				delta |= (uint64_t)(*p++ & 0x7F) << shift;
+				shift += 7;
+			}
+			if (p < end)
+				delta |= (uint64_t)*p++ << shift;
+			
+			b += delta;
+			if (b < idx->hdr->blocks)
+				hit[b / 64] |= 1ULL << (b % 64);
+		}
+		
+		for (w = 0; w < words; ++w) 
+			cand[w] &= hit[w] | (hit[w] >> 1) | (hit[w + 1] << 63);
+	}
+	
+	// scan the candidate blocks, neighbours together, from the offset on
+	for (b = src->pos / IDX_BLK; b < idx->hdr->blocks; ) 
+	{
+		off_t start, end, stop;
+		const byte * data;
+		size_t n, pos = 0;
+		
+		if ( !(cand[b / 64] & (1ULL << (b % 64))) )
+		{
+			++b;
+			continue;
+		}
+		
+		start = b * (off_t)IDX_BLK;
+		while (b < idx->hdr->blocks && (cand[b / 64] & (1ULL << (b % 64))) && 
+		(b + 1) * (off_t)IDX_BLK - start <= PAR_CHUNK)
+			++b;
+		
+		end = (b * (off_t)IDX_BLK < file_end) ? b * (off_t)IDX_BLK : file_end;
+		if (start < src->pos)
+			start = src->pos;
+		
+		stop = end + pat->len - 1;
+		if (stop > file_end)
+			stop = file_end;
+		
+		if (stop <= start)
+			continue;
+		
+		n = stop - start;
+		if (src->map)
+			data = src->map + start;
+		else
+		{
+			if (!buff && !(buff = (byte *)malloc(PAR_CHUNK + pat->len)) )
+			{
+				fprintf(stderr, "Err: unable to allocate search buffer.\n");
+				exit(1);
+			}
+			n = src_pread(src, buff, n, start);
+			data = buff;
+		}
+		
+		while (srch_scan(pat, data, n, &pos) && start + (off_t)pos < end)
+		{
+			srch_report(start + pos, NULL);
+			++*matches_found;
+			++pos;
+		}
+	}
+	
+	free(buff);
+	free(hit);
+	free(cand);
+	return true;
+}
+
+void sig_search(const char * fname, const char * sig_file)
+{
+	// -sf search for every pattern in sig_file in one pass
+	SIG_AC ac;
+	
+	if (replace_everything)
+	{
+		fprintf(stderr, "Err: -%c%c doesn't work with -%c%c.\n", REPLACE, EVERYTHING, SRCH, SIG_FILE);
+		exit(1);
+	}
+	
+	// there is no chunked multi-pattern scan, -j would be silently ignored
+	if (jobs > 1)
+	{
+		fprintf(stderr, "Err: -%c%c doesn't work with -%c.\n", SRCH, SIG_FILE, JOBS);
+		exit(1);
+	}
+	
+	sig_load(&ac, sig_file);
+	sig_scan(&ac, fname);
+}
+
+void enc_search(const char * fname, const char * str)
+{
+	// -suall search for str in every encoding in one pass
+	SIG_AC ac;
+	int enc;
+	
+	if (replace_everything)
+	{
+		fprintf(stderr, "Err: -%c%c doesn't work with -%c%c%s.\n", REPLACE, EVERYTHING, SRCH, UNICODE, ENC_ALL_NAME);
+		exit(1);
+	}
+	
+	if (no_case)
+	{
+		fprintf(stderr, "Err: -%c%c%s can't ignore case.\n", SRCH, UNICODE, ENC_ALL_NAME);
+		exit(1);
+	}
+	
+	// it's the -sf scan, which has no threads
+	if (jobs > 1)
+	{
+		fprintf(stderr, "Err: -%c%c%s doesn't work with -%c.\n", SRCH, UNICODE, ENC_ALL_NAME, JOBS);
+		exit(1);
+	}
+	
+	memset(&ac, 0, sizeof(SIG_AC));
+	ac.names = ENC_NAME;
+	
+	for (enc = 0; enc < ENC_ALL; ++enc) 
+	{
+		int len;
+		byte * seq = str_to_enc(str, enc, &len);
+		
+		sig_add(&ac, seq, len);
+	}
+	
+	sig_scan(&ac, fname);
+}
+
+void sig_scan(SIG_AC * ac_ptr, const char * fname)
+{
+	/* builds the Aho-Corasick automaton of the patterns in ac_ptr,
+	 * see sig_build(), and finds all of them in fname in one pass
+	 * matches are found where they end, so they are held back until
+	 * no later match can start before them and printed by start offset
+	 * a mapped file comes as one block, so they are printed every BLK_SIZE
+	 * bytes, and only the matches of one slice are ever held */
+	
+	SIG_AC ac;
+	SRC src;
+	SIG_MATCH * found = NULL;
+	const byte * data;
+	size_t n, i, k, end, count = 0, cap = 0;
+	off_t base;
+	int x = 0; // see sig_pack()
+	unsigned long long matches_found = 0;
+	
+	sig_build(ac_ptr);
+	ac = *ac_ptr;
+	
+	src_open(&src, fname);
+	base = src.pos;
+	
+	while ( (n = src_next(&src, 0, &data)) > 0 )
+	{
+		for (k = 0; k < n; k = end) 
+		{
+			end = (n - k > BLK_SIZE) ? k + BLK_SIZE : n;
+			
+			for (i = k; i < end; ++i) 
+			{
+				x = ac.delta[(x >> 1) + ac.cls[data[i]]];
+				
+				if (x & 1)
+				{
+					int o, p;
+					
+					// every pattern which ends here, the state's own and its suffixes'
+					for (o = (x >> 1) / ac.classes; o > 0; o = ac.dict[o]) 
+					{
+						for (p = ac.head[o]; p >= 0; p = ac.same[p]) 
+						{
+							if (count == cap)
+							{
+								cap = cap ? cap * 2 : 1024;
+								if ( !(found = (SIG_MATCH *)realloc(found, cap * sizeof(SIG_MATCH))) )
+								{
+									fprintf(stderr, "Err: memory allocation failed.\n");
+									exit(1);
+								}
+							}
+							
+							found[count].pos = base + i + 1 - ac.len[p];
+							found[count].id = p;
+							++count;
+						}
+					}
+				}
+			}
+			
+			// a later match can start no earlier than max_len - 1 bytes back
+			count = sig_report(&ac, found, count, base + end - ac.max_len + 1, &matches_found);
+		}
+		
+		base += n;
+	}
+	
+	sig_report(&ac, found, count, base + 1, &matches_found);
+	fprintf(stdout, "%llu %s found.\n", matches_found, (matches_found != 1) ? "matches" : "match");
+	
+	free(found);
+	sig_free(&ac);
+	src_close(&src);
+}
+
+static int cmp_sig_match(const void * a, const void * b)
+{
+	const SIG_MATCH * x = (const SIG_MATCH *)a, * y = (const SIG_MATCH *)b;
+	
+	if (x->pos != y->pos)
+		return (x->pos > y->pos) - (x->pos < y->pos);
+	return x->id - y->id;
+}
+
+size_t sig_report(const SIG_AC * ac, SIG_MATCH * found, size_t count, off_t upto, unsigned long long * matches_found)
+{
+	/* prints the matches which start before upto by offset, then by pattern
+	 * and moves the rest to the front; returns how many are left
+	 * a match shows the name of its pattern, or its number if there are no names */
+	
+	size_t i, left = 0;
+	
+	qsort(found, count, sizeof(SIG_MATCH), cmp_sig_match);
+	
+	for (i = 0; i < count && found[i].pos < upto; ++i) 
+	{
+		if (ac->names)
+			fprintf(stdout, "Match found at: %#llx %s\n", (unsigned long long)found[i].pos, ac->names[found[i].id]);
+		else
+			fprintf(stdout, "Match found at: %#llx pattern %d\n", (unsigned long long)found[i].pos, found[i].id + 1);
+	}
+	
+	*matches_found += i;
+	
+	for ( ; i < count; ++i) 
+		found[left++] = found[i];
+	
+	return left;
+}
+
+void sig_load(SIG_AC * ac, const char * sig_file)
+{
+	/* reads the patterns of sig_file, one on each line
+	 * a <string>, u <string> or b <hex bytes>, like -sa, -su and -sb
+	 * u can be ule, ube or u8 as well
+	 * empty lines and lines starting with # are skipped */
+	
+	FILE * fp = open_file(sig_file, "r");
+	char * line = NULL;
+	size_t line_cap = 0;
+	ssize_t line_len;
+	int line_num = 0;
+	
+	memset(ac, 0, sizeof(SIG_AC));
+	
+	// open_file() seeks to -o, which is meant for the searched file
+	if (!is_std(sig_file))
+		rewind(fp);
+	
+	while ( (line_len = getline(&line, &line_cap, fp)) >= 0 )
+	{
+		char * str = strchr(line, ' ');
+		byte * seq;
+		int len, enc = ENC_ALL;
+		
+		++line_num;
+		
+		while (line_len > 0 && ('\n' == line[line_len - 1] || '\r' == line[line_len - 1]))
+			line[--line_len] = '\0';
+		
+		if (0 == line_len || '#' == line[0])
+			continue;
+		
+		if (str)
+			*str++ = '\0';
+		
+		if (UNICODE == line[0])
+			enc = get_encoding(line + 1);
+		
+		if (!str || '\0' == *str || (UNICODE == line[0] && ENC_ALL == enc) ||
+		(UNICODE != line[0] && ((ASCII != line[0] && BIN != line[0]) || '\0' != line[1])))
+		{
+			fprintf(stderr, "Err: bad pattern on line %d of %s.\n", line_num, sig_file);
+			exit(1);
+		}
+		
+		seq = (UNICODE == line[0]) ? str_to_enc(str, enc, &len) : seq_to_bytes(line[0], str, &len);
+		if (0 == len)
+		{
+			fprintf(stderr, "Err: empty pattern on line %d of %s.\n", line_num, sig_file);
+			exit(1);
+		}
+		
+		sig_add(ac, seq, len);
+	}
+	
+	free(line);
+	fclose(fp);
+	
+	if (0 == ac->count)
+	{
+		fprintf(stderr, "Err: no patterns in %s.\n", sig_file);
+		exit(1);
+	}
+}
+
+void sig_add(SIG_AC * ac, byte * seq, int len)
+{
+	// adds a pattern to ac, which frees seq later
+	if ( !(ac->count % 256) && 
+	(!(ac->seq = (byte **)realloc(ac->seq, (ac->count + 256) * sizeof(byte *))) ||
+	!(ac->len = (int *)realloc(ac->len, (ac->count + 256) * sizeof(int)))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	ac->seq[ac->count] = seq;
+	ac->len[ac->count] = len;
+	
+	if (len > ac->max_len)
+		ac->max_len = len;
+	++ac->count;
+}
+
+void sig_build(SIG_AC * ac)
+{
+	/* builds the Aho-Corasick automaton of the patterns as a dfa
+	 * bytes which are in no pattern share class 0, the others get a class
+	 * each, and delta holds the next state for every state and class
+	 * in one array, so the scan is a single lookup per byte */
+	
+	int i, j, c, states = 1, cap = 0, * queue, qhead = 0, qtail = 0;
+	
+	for (i = 0, ac->classes = 1; i < ac->count; ++i) 
+	{
+		for (j = 0; j < ac->len[i]; ++j) 
+		{
+			if (!ac->cls[ac->seq[i][j]])
+				ac->cls[ac->seq[i][j]] = ac->classes++;
+		}
+	}
+	
+	// the trie, -1 marks a missing edge
+	for (i = 0; i < ac->count; ++i) 
+		cap += ac->len[i];
+	++cap;
+	
+	ac->delta = (int *)malloc((size_t)cap * ac->classes * sizeof(int));
+	ac->fail = (int *)calloc(cap, sizeof(int));
+	ac->dict = (int *)calloc(cap, sizeof(int));
+	ac->head = (int *)malloc(cap * sizeof(int));
+	ac->hit = (byte *)calloc(cap, sizeof(byte));
+	ac->same = (int *)malloc(ac->count * sizeof(int));
+	queue = (int *)malloc(cap * sizeof(int));
+	
+	if (!ac->delta || !ac->fail || !ac->dict || !ac->head || !ac->hit || !ac->same || !queue)
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	memset(ac->delta, 0xFF, (size_t)cap * ac->classes * sizeof(int));
+	memset(ac->head, 0xFF, cap * sizeof(int));
+	
+	for (i = 0; i < ac->count; ++i) 
+	{
+		int s = 0;
+		
+		for (j = 0; j < ac->len[i]; ++j) 
+		{
+			int * edge = ac->delta + (size_t)s * ac->classes + ac->cls[ac->seq[i][j]];
+			
+			if (*edge < 0)
+				*edge = states++;
+			s = *edge;
+		}
+		
+		// the same pattern twice reports twice
+		ac->same[i] = ac->head[s];
+		ac->head[s] = i;
+	}
+	
+	// breadth first, every state's fail state is done before the state
+	for (c = 0; c < ac->classes; ++c) 
+	{
+		int t = ac->delta[c];
+		
+		if (t < 0)
+			ac->delta[c] = 0;
+		else
+			queue[qtail++] = t;
+	}
+	
+	while (qhead < qtail)
+	{
+		int s = queue[qhead++];
+		
+		ac->hit[s] = (ac->head[s] >= 0 || ac->hit[ac->dict[s]]);
+		
+		for (c = 0; c < ac->classes; ++c) 
+		{
+			int * edge = ac->delta + (size_t)s * ac->classes + c;
+			int f = ac->delta[(size_t)ac->fail[s] * ac->classes + c];
+			
+			if (*edge < 0)
+			{
+				*edge = f;
+				continue;
+			}
+			
+			ac->fail[*edge] = f;
+			// the longest suffix which ends a pattern
+			ac->dict[*edge] = (ac->head[f] >= 0) ? f : ac->dict[f];
+			queue[qtail++] = *edge;
+		}
+	}
+	
+	sig_pack(ac, states, queue);
+	free(queue);
+}
+
+void sig_pack(SIG_AC * ac, int states, int * queue)
+{
+	/* renumbers the states breadth first, so the shallow ones, where a scan
+	 * spends most of its time, share cache lines, and turns every delta entry
+	 * into the row of the next state shifted left by one, with the hit flag
+	 * of that state in the low bit; queue has room for every state */
+	
+	int * map = (int *)malloc(states * sizeof(int));
+	int * delta = (int *)malloc((size_t)states * ac->classes * sizeof(int));
+	int * dict = (int *)malloc(states * sizeof(int));
+	int * head = (int *)malloc(states * sizeof(int));
+	int i, c, qhead = 0, qtail = 0;
+	
+	if (!map || !delta || !dict || !head)
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	memset(map, 0xFF, states * sizeof(int));
+	map[0] = 0;
+	queue[qtail++] = 0;
+	
+	while (qhead < qtail)
+	{
+		int s = queue[qhead++];
+		
+		for (c = 0; c < ac->classes; ++c) 
+		{
+			int t = ac->delta[(size_t)s * ac->classes + c];
+			
+			if (map[t] < 0)
+			{
+				map[t] = qtail;
+				queue[qtail++] = t;
+			}
+		}
+	}
+	
+	for (i = 0; i < states; ++i) 
+	{
+		for (c = 0; c < ac->classes; ++c) 
+		{
+			int t = ac->delta[(size_t)i * ac->classes + c];
+			delta[(size_t)map[i] * ac->classes + c] = ((map[t] * ac->classes) << 1) | ac->hit[t];
+		}
+		
+		dict[map[i]] = map[ac->dict[i]];
+		head[map[i]] = ac->head[i];
+	}
+	
+	free(ac->delta);
+	free(ac->dict);
+	free(ac->head);
+	free(map);
+	
+	ac->delta = delta;
+	ac->dict = dict;
+	ac->head = head;
+}
+
+void sig_free(SIG_AC * ac)
+{
+	// releases what sig_load() and sig_build() allocated
+	int i;
+	
+	for (i = 0; i < ac->count; ++i) 
+		free(ac->seq[i]);
+	
+	free(ac->seq);
+	free(ac->len);
+	free(ac->delta);
+	free(ac->fail);
+	free(ac->dict);
+	free(ac->head);
+	free(ac->hit);
+	free(ac->same);
+}
+
+void pat_search(const char * fname, const char * pattern)
+{
+	/* -sp search for a byte pattern
+	 * a forward DFA, which restarts the pattern at every byte, finds where
+	 * matches end; from every end a reversed DFA walks back to find where
+	 * they start, so every start is reported once and in ascending order */
+	
+	SRC src;
+	PAT_NODE * root;
+	SRCH_DFA fwd, rev;
+	const char * p = pattern;
+	const byte * data;
+	byte * pend;
+	size_t n, carry = 0, i, win = 1;
+	off_t base, done;
+	int min, max, s;
+	unsigned long long matches_found = 0, pending = 0;
+	
+	if (replace_everything)
+	{
+		fprintf(stderr, "Err: -%c%c doesn't work with -%c%c.\n", REPLACE, EVERYTHING, SRCH, PATTERN);
+		exit(1);
+	}
+	
+	// there is no chunked pattern scan, -j would be silently ignored
+	if (jobs > 1)
+	{
+		fprintf(stderr, "Err: -%c%c doesn't work with -%c.\n", SRCH, PATTERN, JOBS);
+		exit(1);
+	}
+	
+	root = pat_alt(&p);
+	if ('\0' != *p)
+	{
+		fprintf(stderr, "Err: bad pattern at \"%s\".\n", p);
+		exit(1);
+	}
+	
+	pat_len(root, &min, &max);
+	if (0 == min)
+	{
+		fprintf(stderr, "Err: the pattern can match an empty sequence.\n");
+		exit(1);
+	}
+	
+	dfa_init(&fwd, root, false, true);
+	dfa_init(&rev, root, true, false);
+	pat_free(root);
+	
+	// the starts found so far which can't be printed yet
+	while (win <= (size_t)max)
+		win <<= 1;
+	if ( !(pend = (byte *)calloc(win, sizeof(byte))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	src_open(&src, fname);
+	base = done = src.pos;
+	s = dfa_first(&fwd);
+	
+	// every block keeps the max - 1 bytes the walk back might need
+	while ( (n = src_next(&src, carry, &data)) > 0 )
+	{
+		for (i = carry; i < n; ++i) 
+		{
+			int t = fwd.next[s * 256 + data[i]];
+			
+			s = (t >= 0) ? t : dfa_step(&fwd, s, data[i]);
+			
+			if (fwd.accept[s])
+			{
+				size_t j = i + 1, stop = (i + 1 > (size_t)max) ? i + 1 - max : 0;
+				int r = dfa_first(&rev);
+				
+				// this end and the later ones can't start a match before base + stop
+				pat_report(pend, win, &done, base + stop, &pending, &matches_found);
+				
+				while (j > stop && !rev.dead[r])
+				{
+					--j;
+					t = rev.next[r * 256 + data[j]];
+					r = (t >= 0) ? t : dfa_step(&rev, r, data[j]);
+					
+					if (rev.accept[r] && !pend[(base + j) & (win - 1)])
+					{
+						pend[(base + j) & (win - 1)] = 1;
+						++pending;
+					}
+				}
+			}
+		}
+		
+		carry = (n < (size_t)max - 1) ? n : (size_t)max - 1;
+		base += n - carry;
+	}
+	
+	pat_report(pend, win, &done, base + (off_t)win, &pending, &matches_found);
+	
+	fprintf(stdout, "%llu %s found.\n", matches_found, (matches_found != 1) ? "matches" : "match");
+	
+	free(pend);
+	dfa_free(&fwd);
+	dfa_free(&rev);
+	src_close(&src);
+}
+
+void pat_report(byte * pend, size_t win, off_t * done, off_t upto, unsigned long long * pending, unsigned long long * matches_found)
+{
+	/* prints the pending starts before upto in ascending order
+	 * pend is a ring of win flags, one for every offset from *done on */
+	
+	for ( ; *pending > 0 && *done < upto; ++*done) 
+	{
+		if (pend[*done & (win - 1)])
+		{
+			pend[*done & (win - 1)] = 0;
+			--*pending;
+			srch_report(*done, NULL);
+			++*matches_found;
+		}
+	}
+	
+	if (*done < upto)
+		*done = upto;
+}
+
+PAT_NODE * pat_node(int type)
+{
+	// returns a new empty pattern node
+	PAT_NODE * node;
+	
+	if ( !(node = (PAT_NODE *)calloc(1, sizeof(PAT_NODE))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	node->type = type;
+	return node;
+}
+
+void pat_add(PAT_NODE * node, PAT_NODE * kid)
+{
+	// appends kid to the kids of node
+	if ( !(node->count % 8) &&
+	!(node->kids = (PAT_NODE **)realloc(node->kids, (node->count + 8) * sizeof(PAT_NODE *))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	node->kids[node->count++] = kid;
+}
+
+PAT_NODE * pat_byte(int val, int mask)
+{
+	// returns a class node for every byte b with (b & mask) == val
+	PAT_NODE * node = pat_node(PN_CLASS);
+	int b;
+	
+	for (b = 0; b < 256; ++b) 
+	{
+		if ((b & mask) == val)
+			node->cls[b >> 6] |= 1ULL << (b & 63);
+	}
+	
+	return node;
+}
+
+PAT_NODE * pat_alt(const char ** s)
+{
+	// alternative := sequence { '|' sequence }
+	PAT_NODE * node = pat_cat(s), * alt;
+	
+	if (PAT_OR != **s)
+		return node;
+	
+	alt = pat_node(PN_ALT);
+	pat_add(alt, node);
+	
+	while (PAT_OR == **s)
+	{
+		++*s;
+		pat_add(alt, pat_cat(s));
+	}
+	
+	return alt;
+}
+
+PAT_NODE * pat_cat(const char ** s)
+{
+	// sequence := { item } up to '|', ')' or the end
+	PAT_NODE * node = pat_node(PN_CAT);
+	
+	while (true)
+	{
+		while (isspace((byte)**s))
+			++*s;
+		
+		if ('\0' == **s || PAT_OR == **s || ')' == **s)
+			break;
+		
+		pat_item(node, s);
+	}
+	
+	return node;
+}
+
+void pat_item(PAT_NODE * cat, const char ** s)
+{
+	/* adds the next item of a sequence to cat
+	 * item := hex bytes | ?? | H? | ?L | [set] | {n} | {n-m} | "ascii" | ( alternative ) */
+	
+	const char * p = *s, * at = *s;
+	
+	if ('(' == *p)
+	{
+		*s = p + 1;
+		pat_add(cat, pat_alt(s));
+		if (')' != **s)
+			goto bad_pattern;
+		++*s;
+	}
+	else if ('[' == *p)
+		pat_add(cat, pat_set(s));
+	else if ('{' == *p)
+	{
+		PAT_NODE * gap = pat_node(PN_GAP);
+		char * end;
+		
+		gap->min = gap->max = strtol(p + 1, &end, 10);
+		if (end == p + 1)
+			goto bad_pattern;
+		
+		if ('-' == *end)
+		{
+			p = end + 1;
+			gap->max = strtol(p, &end, 10);
+			if (end == p)
+				goto bad_pattern;
+		}
+		
+		if ('}' != *end || gap->min < 0 || gap->max < gap->min || gap->max > PAT_MAX_GAP)
+			goto bad_pattern;
+		
+		pat_add(cat, gap);
+		*s = end + 1;
+	}
+	else if ('"' == *p)
+	{
+		for (++p; '\0' != *p && '"' != *p; ++p) 
+			pat_add(cat, pat_byte((byte)*p, 0xFF));
+		
+		if ('"' != *p)
+			goto bad_pattern;
+		*s = p + 1;
+	}
+	else if ('?' == *p)
+	{
+		if ('?' == p[1])
+			pat_add(cat, pat_byte(0, 0));
+		else if (isxdigit((byte)p[1]))
+			pat_add(cat, pat_byte(HEX_VAL[(byte)p[1]], 0x0F));
+		else
+			goto bad_pattern;
+		*s = p + 2;
+	}
+	else if (isxdigit((byte)*p))
+	{
+		// literal bytes go through hexstr_to_bytes(), up to the first other character
+		const char * end = p, * last = p;
+		int digits = 0, i, len;
+		byte * bytes;
+		char * lit;
+		
+		for ( ; isxdigit((byte)*end) || ' ' == *end || '\t' == *end; ++end) 
+		{
+			if (isxdigit((byte)*end))
+			{
+				++digits;
+				last = end;
+			}
+		}
+		
+		// an odd digit out is the high nibble of H?
+		if (digits % 2)
+		{
+			if ('?' != last[1])
+				goto bad_pattern;
+			end = last;
+		}
+		
+		if ( !(lit = (char *)malloc(end - p + 1)) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+		memcpy(lit, p, end - p);
+		lit[end - p] = '\0';
+		
+		bytes = hexstr_to_bytes(lit, &len);
+		for (i = 0; i < len; ++i) 
+			pat_add(cat, pat_byte(bytes[i], 0xFF));
+		
+		free(bytes);
+		free(lit);
+		
+		if (digits % 2)
+		{
+			pat_add(cat, pat_byte(HEX_VAL[(byte)*last] << 4, 0xF0));
+			end = last + 2;
+		}
+		*s = end;
+	}
+	else
+		goto bad_pattern;
+	
+	return;
+	
+	bad_pattern:
+		fprintf(stderr, "Err: bad pattern at \"%s\".\n", at);
+		exit(1);
+}
+
+PAT_NODE * pat_set(const char ** s)
+{
+	// set := '[' [ '^' ] { HH | HH-HH } ']'
+	PAT_NODE * node = pat_node(PN_CLASS);
+	const char * p = *s + 1;
+	bool negate = false;
+	int i;
+	
+	if ('^' == *p)
+	{
+		negate = true;
+		++p;
+	}
+	
+	while (']' != *p)
+	{
+		int lo, hi;
+		
+		if (isspace((byte)*p))
+		{
+			++p;
+			continue;
+		}
+		
+		if (!isxdigit((byte)p[0]) || !isxdigit((byte)p[1]))
+			goto bad_set;
+		lo = hi = (HEX_VAL[(byte)p[0]] << 4) | HEX_VAL[(byte)p[1]];
+		p += 2;
+		
+		if ('-' == *p)
+		{
+			if (!isxdigit((byte)p[1]) || !isxdigit((byte)p[2]))
+				goto bad_set;
+			hi = (HEX_VAL[(byte)p[1]] << 4) | HEX_VAL[(byte)p[2]];
+			p += 3;
+		}
+		
+		if (hi < lo)
+			goto bad_set;
+		
+		for (i = lo; i <= hi; ++i) 
+			node->cls[i >> 6] |= 1ULL << (i & 63);
+	}
+	
+	if (negate)
+	{
+		for (i = 0; i < 4; ++i) 
+			node->cls[i] = ~node->cls[i];
+	}
+	
+	*s = p + 1;
+	return node;
+	
+	bad_set:
+		fprintf(stderr, "Err: bad pattern at \"%s\".\n", *s);
+		exit(1);
+}
+
+void pat_len(const PAT_NODE * node, int * min, int * max)
+{
+	// the shortest and the longest sequence node can match
+	int i, kmin, kmax;
+	
+	switch (node->type)
+	{
+		case PN_CLASS:
+			*min = *max = 1;
+			break;
+		case PN_GAP:
+			*min = node->min;
+			*max = node->max;
+			break;
+		case PN_CAT:
+			*min = *max = 0;
+			for (i = 0; i < node->count; ++i) 
+			{
+				pat_len(node->kids[i], &kmin, &kmax);
+				*min += kmin;
+				*max += kmax;
+			}
+			break;
+		case PN_ALT:
+			for (i = 0; i < node->count; ++i) 
+			{
+				pat_len(node->kids[i], &kmin, &kmax);
+				if (0 == i || kmin < *min)
+					*min = kmin;
+				if (0 == i || kmax > *max)
+					*max = kmax;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+void pat_free(PAT_NODE * node)
+{
+	// frees node and all under it
+	int i;
+	
+	for (i = 0; i < node->count; ++i) 
+		pat_free(node->kids[i]);
+	
+	free(node->kids);
+	free(node);
+}
+
+int nfa_add(SRCH_DFA * dfa, int type, int out, int out1, const uint64_t * cls)
+{
+	// appends an nfa state and returns its number
+	NFA_ST * st;
+	
+	if (dfa->nfa_len == dfa->nfa_cap)
+	{
+		dfa->nfa_cap = dfa->nfa_cap ? dfa->nfa_cap * 2 : 64;
+		if ( !(dfa->nfa = (NFA_ST *)realloc(dfa->nfa, dfa->nfa_cap * sizeof(NFA_ST))) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+	}
+	
+	st = dfa->nfa + dfa->nfa_len;
+	st->type = type;
+	st->out = out;
+	st->out1 = out1;
+	if (cls)
+		memcpy(st->cls, cls, sizeof(st->cls));
+	
+	return dfa->nfa_len++;
+}
+
+int nfa_build(SRCH_DFA * dfa, const PAT_NODE * node, int next, bool reverse)
+{
+	/* builds the nfa of node in front of the state next and returns its start
+	 * with reverse the sequences are built back to front */
+	
+	static const uint64_t any[4] = {~0ULL, ~0ULL, ~0ULL, ~0ULL};
+	int i, s;
+	
+	switch (node->type)
+	{
+		case PN_CLASS:
+			return nfa_add(dfa, NFA_CLASS, next, -1, node->cls);
+		case PN_CAT:
+			for (i = 0; i < node->count; ++i) 
+				next = nfa_build(dfa, node->kids[reverse ? i : node->count - 1 - i], next, reverse);
+			return next;
+		case PN_ALT:
+			s = nfa_build(dfa, node->kids[0], next, reverse);
+			for (i = 1; i < node->count; ++i) 
+				s = nfa_add(dfa, NFA_SPLIT, s, nfa_build(dfa, node->kids[i], next, reverse), NULL);
+			return s;
+		case PN_GAP:
+			// min bytes, then up to max - min more, each of which may be the last
+			for (s = next, i = node->min; i < node->max; ++i) 
+				s = nfa_add(dfa, NFA_SPLIT, nfa_add(dfa, NFA_CLASS, s, -1, any), next, NULL);
+			for (i = 0; i < node->min; ++i) 
+				s = nfa_add(dfa, NFA_CLASS, s, -1, any);
+			return s;
+		default:
+			return next;
+	}
+}
+
+void dfa_init(SRCH_DFA * dfa, const PAT_NODE * root, bool reverse, bool floating)
+{
+	/* builds the nfa of root and sets up the empty dfa cache
+	 * a floating dfa starts the pattern over at every byte */
+	
+	memset(dfa, 0, sizeof(SRCH_DFA));
+	dfa->start = nfa_build(dfa, root, nfa_add(dfa, NFA_MATCH, -1, -1, NULL), reverse);
+	dfa->floating = floating;
+	
+	dfa->next = (int *)malloc(DFA_STATES * 256 * sizeof(int));
+	dfa->accept = (byte *)malloc(DFA_STATES);
+	dfa->dead = (byte *)malloc(DFA_STATES);
+	dfa->set_at = (size_t *)malloc(DFA_STATES * sizeof(size_t));
+	dfa->set_len = (int *)malloc(DFA_STATES * sizeof(int));
+	dfa->hash = (int *)malloc(DFA_HASH * sizeof(int));
+	dfa->mark = (unsigned *)calloc(dfa->nfa_len, sizeof(unsigned));
+	dfa->list = (int *)malloc(dfa->nfa_len * sizeof(int));
+	dfa->stack = (int *)malloc(dfa->nfa_len * sizeof(int));
+	dfa->cur = (int *)malloc(dfa->nfa_len * sizeof(int));
+	dfa->sets_cap = DFA_STATES * 16;
+	dfa->sets = (int *)malloc(dfa->sets_cap * sizeof(int));
+	
+	if (!dfa->next || !dfa->accept || !dfa->dead || !dfa->set_at || !dfa->set_len || 
+	!dfa->hash || !dfa->mark || !dfa->list || !dfa->stack || !dfa->cur || !dfa->sets)
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	dfa_flush(dfa);
+}
+
+void dfa_flush(SRCH_DFA * dfa)
+{
+	// drops every cached dfa state
+	memset(dfa->next, 0xFF, DFA_STATES * 256 * sizeof(int));
+	memset(dfa->hash, 0xFF, DFA_HASH * sizeof(int));
+	dfa->count = 0;
+	dfa->sets_len = 0;
+	dfa->first = -1;
+}
+
+void dfa_free(SRCH_DFA * dfa)
+{
+	// releases what dfa_init() allocated
+	free(dfa->nfa);
+	free(dfa->next);
+	free(dfa->accept);
+	free(dfa->dead);
+	free(dfa->set_at);
+	free(dfa->set_len);
+	free(dfa->hash);
+	free(dfa->mark);
+	free(dfa->list);
+	free(dfa->stack);
+	free(dfa->cur);
+	free(dfa->sets);
+}
+
+void dfa_closure(SRCH_DFA * dfa, int st, int * len)
+{
+	// adds st and every state reachable from it without input to dfa->list
+	int top = 0;
+	
+	dfa->stack[top++] = st;
+	while (top > 0)
+	{
+		int s = dfa->stack[--top];
+		
+		if (dfa->mark[s] == dfa->gen)
+			continue;
+		dfa->mark[s] = dfa->gen;
+		
+		if (NFA_SPLIT == dfa->nfa[s].type)
+		{
+			dfa->stack[top++] = dfa->nfa[s].out1;
+			dfa->stack[top++] = dfa->nfa[s].out;
+		}
+		else
+			dfa->list[(*len)++] = s;
+	}
+}
+
+static int cmp_int(const void * a, const void * b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+int dfa_state(SRCH_DFA * dfa, int len)
+{
+	/* returns the dfa state for the set of nfa states in dfa->list
+	 * and adds it to the cache if it isn't there, flushing the cache first
+	 * if it's full; the caller knows about a flush from dfa->flushes */
+	
+	uint32_t h = 2166136261u;
+	int i, id;
+	
+	qsort(dfa->list, len, sizeof(int), cmp_int);
+	for (i = 0; i < len; ++i) 
+		h = (h ^ (uint32_t)dfa->list[i]) * 16777619u;
+	
+	for (h %= DFA_HASH; (id = dfa->hash[h]) >= 0; h = (h + 1) % DFA_HASH) 
+	{
+		if (dfa->set_len[id] == len && 
+		0 == memcmp(dfa->sets + dfa->set_at[id], dfa->list, len * sizeof(int)))
+			return id;
+	}
+	
+	if (DFA_STATES == dfa->count || dfa->sets_len + len > dfa->sets_cap)
+	{
+		dfa_flush(dfa);
+		++dfa->flushes;
+		return dfa_state(dfa, len);
+	}
+	
+	id = dfa->count++;
+	dfa->hash[h] = id;
+	dfa->set_at[id] = dfa->sets_len;
+	dfa->set_len[id] = len;
+	memcpy(dfa->sets + dfa->sets_len, dfa->list, len * sizeof(int));
+	dfa->sets_len += len;
+	
+	dfa->accept[id] = 0;
+	dfa->dead[id] = (0 == len && !dfa->floating);
+	for (i = 0; i < len; ++i) 
+	{
+		if (NFA_MATCH == dfa->nfa[dfa->list[i]].type)
+			dfa->accept[id] = 1;
+	}
+	
+	return id;
+}
+
+int dfa_first(SRCH_DFA * dfa)
+{
+	// returns the state before any input
+	int len = 0;
+	
+	if (dfa->first < 0)
+	{
+		++dfa->gen;
+		dfa_closure(dfa, dfa->start, &len);
+		dfa->first = dfa_state(dfa, len);
+	}
+	
+	return dfa->first;
+}
+
+int dfa_step(SRCH_DFA * dfa, int s, byte b)
+{
+	/* works out and caches the state after s reads b
+	 * the set of s is copied out first, since a flush can overwrite it
+	 * a floating dfa adds the start of the pattern after every byte */
+	
+	int i, len = 0, cur_len = dfa->set_len[s], id;
+	unsigned flushes = dfa->flushes;
+	
+	memcpy(dfa->cur, dfa->sets + dfa->set_at[s], cur_len * sizeof(int));
+	++dfa->gen;
+	
+	for (i = 0; i < cur_len; ++i) 
+	{
+		const NFA_ST * st = dfa->nfa + dfa->cur[i];
+		
+		if (NFA_CLASS == st->type && (st->cls[b >> 6] >> (b & 63) & 1))
+			dfa_closure(dfa, st->out, &len);
+	}
+	
+	if (dfa->floating)
+		dfa_closure(dfa, dfa->start, &len);
+	
+	id = dfa_state(dfa, len);
+	if (flushes == dfa->flushes)
+		dfa->next[s * 256 + b] = id;
+	
+	return id;
+}
+
+void replace(const char mode, const char * fname, const char * sequence)
+{
+	// writes a sequence starting from an offset in the file
+	
+	// check replace mode
+	if (BIN != mode && ASCII != mode && UNICODE != mode)
+	{
+		fprintf(stderr, "Err: invalid replace mode.\n");
+		exit(1);
+	}
+	
+	PATCH patch;
+	
+	patch_open(&patch, mode, fname, sequence);
+	patch_add(&patch, offset);
+	patch_close(&patch);
+	
+	fprintf(stdout, "Replace successful.\n");
+}
+
+void patch_open(PATCH * patch, const char mode, const char * fname, const char * sequence)
+{
+	/* converts the replace sequence once and opens the file for writing
+	 * binary read/write allows random access */
+	
+	char * name = side_name(fname, JRN_EXT);
+	
+	patch->seq = seq_to_bytes(mode, sequence, &patch->len);
+	patch->fp = open_file(fname, "rb+");
+	
+	// a file with a journal keeps it going, -J starts one
+	patch->is_jrn = journal || 0 == access(name, F_OK);
+	if (patch->is_jrn)
+		jrn_open(&patch->jrn, fileno(patch->fp), fname);
+	free(name);
+
+	patch->run = NULL;
+	patch->run_start = 0;
+	patch->run_len = 0;
+	patch->run_cap = 0;
+}
+
+void patch_add(PATCH * patch, off_t pos)
+{
+	/* puts the replace sequence at pos in the run
+	 * positions must come in ascending order; nothing before pos
+	 * can change anymore, so that part of the run gets written if
+	 * pos is past the run or the run has grown past BLK_SIZE */
+	
+	size_t need;
+	
+	if (patch->run_len && (pos > patch->run_start + (off_t)patch->run_len || 
+	pos - patch->run_start >= BLK_SIZE))
+		patch_flush(patch, pos);
+	
+	if (0 == patch->run_len)
+		patch->run_start = pos;
+	
+	need = pos - patch->run_start + patch->len;
+	if (need > patch->run_cap)
+	{
+		patch->run_cap = need * 2;
+		if ( !(patch->run = (byte *)realloc(patch->run, patch->run_cap)) )
+		{
+			fprintf(stderr, "Err: unable to allocate replace buffer.\n");
+			exit(1);
+		}
+	}
+	
+	memcpy(patch->run + (pos - patch->run_start), patch->seq, patch->len);
+	if (need > patch->run_len)
+		patch->run_len = need;
+}
+
+void patch_flush(PATCH * patch, off_t upto)
+{
+	// writes the part of the run before upto and keeps the rest
+	
+	size_t n = patch->run_len;
+	
+	if (upto - patch->run_start < (off_t)n)
+		n = upto - patch->run_start;
+	
+	if (patch->is_jrn && n > 0)
+		jrn_write(&patch->jrn, patch->run, n, patch->run_start);
+	else
+		pwrite_all(fileno(patch->fp), patch->run, n, patch->run_start);
+	
+	memmove(patch->run, patch->run + n, patch->run_len - n);
+	patch->run_len -= n;
+	patch->run_start += n;
+}
+
+void patch_close(PATCH * patch)
+{
+	// writes what's left and closes the file
+	patch_flush(patch, patch->run_start + patch->run_len);
+	
+	if (patch->is_jrn)
+		jrn_close(&patch->jrn);
+	
+	free(patch->seq);
+	free(patch->run);
+	
+	if (fclose(patch->fp) != 0)
+	{
+		fprintf(stderr, "Err: write error.\n");
+		exit(1);
+	}
+}
+
+void pwrite_all(int fd, const byte * buff, size_t len, off_t pos)
+{
+	// writes len bytes at pos
+	size_t done = 0;
+	
+	while (done < len)
+	{
+		ssize_t w = pwrite(fd, buff + done, len - done, pos + done);
+		
+		if (w < 0 && EINTR == errno)
+			continue;
+		
+		if (w <= 0)
+		{
+			fprintf(stderr, "Err: write error.\n");
+			exit(1);
+		}
+		done += w;
+	}
+}
+
+void jrn_open(JRN * jrn, int fd, const char * fname)
+{
+	/* opens the journal of fname for a new replace, creating it with -J
+	 * the replace gets the next transaction number and a begin record
+	 * with the file size, which undo truncates the file back to */
+	
+	JRN_REC rec;
+	struct stat st;
+	size_t len;
+	
+	jrn->fd = fd;
+	jrn->name = side_name(fname, JRN_EXT);
+	jrn->pend = NULL;
+	jrn->pend_len = 0;
+	jrn->pend_cap = 0;
+	jrn->txn = jrn_last(jrn->name, &len) + 1;
+	
+	// a record cut short by a crash would hide the ones after it
+	if (len > 0 && truncate(jrn->name, len) != 0)
+	{
+		fprintf(stderr, "Err: can't open the journal %s.\n", jrn->name);
+		exit(1);
+	}
+	
+	if ( !(jrn->fp = fopen(jrn->name, "ab")) )
+	{
+		fprintf(stderr, "Err: can't open the journal %s.\n", jrn->name);
+		exit(1);
+	}
+	
+	fseeko(jrn->fp, 0, SEEK_END);
+	if (0 == ftello(jrn->fp))
+		jrn_put(jrn, NULL, JRN_MAGIC, sizeof(JRN_MAGIC) - 1);
+	
+	if (fstat(fd, &st) != 0)
+	{
+		fprintf(stderr, "Err: can't stat the file.\n");
+		exit(1);
+	}
+	
+	rec.type = JRN_BEGIN;
+	rec.txn = jrn->txn;
+	rec.off = st.st_size;
+	rec.old_len = rec.new_len = 0;
+	jrn_put(jrn, &rec, NULL, 0);
+}
+
+void jrn_write(JRN * jrn, const byte * buff, size_t len, off_t pos)
+{
+	/* journals the bytes at pos and holds back their new value
+	 * nothing is written to the file until the journal is on the disk,
+	 * which is done once for every JRN_BATCH bytes, see jrn_sync() */
+	
+	JRN_REC rec;
+	byte * old;
+	size_t need = jrn->pend_len + sizeof(off_t) + sizeof(size_t) + len;
+	
+	if ( !(old = (byte *)malloc(len ? len : 1)) )
+	{
+		fprintf(stderr, "Err: unable to allocate journal buffer.\n");
+		exit(1);
+	}
+	
+	// past the eof there's nothing to keep
+	rec.type = JRN_WRITE;
+	rec.txn = jrn->txn;
+	rec.off = pos;
+	rec.old_len = jrn_pread(jrn->fd, old, len, pos);
+	rec.new_len = len;
+	jrn_put(jrn, &rec, old, rec.old_len);
+	jrn_put(jrn, NULL, buff, len);
+	free(old);
+	
+	if (need > jrn->pend_cap)
+	{
+		jrn->pend_cap = need * 2;
+		if ( !(jrn->pend = (byte *)realloc(jrn->pend, jrn->pend_cap)) )
+		{
+			fprintf(stderr, "Err: unable to allocate journal buffer.\n");
+			exit(1);
+		}
+	}
+	
+	memcpy(jrn->pend + jrn->pend_len, &pos, sizeof(off_t));
+	memcpy(jrn->pend + jrn->pend_len + sizeof(off_t), &len, sizeof(size_t));
+	memcpy(jrn->pend + jrn->pend_len + sizeof(off_t) + sizeof(size_t), buff, len);
+	jrn->pend_len = need;
+	
+	if (jrn->pend_len >= JRN_BATCH)
+		jrn_sync(jrn);
+}
+
+void jrn_sync(JRN * jrn)
+{
+	// puts the journal on the disk, then writes the bytes held back
+	size_t i = 0;
+	
+	jrn_flush(jrn);
+	
+	while (i < jrn->pend_len)
+	{
+		off_t pos;
+		size_t len;
+		
+		memcpy(&pos, jrn->pend + i, sizeof(off_t));
+		memcpy(&len, jrn->pend + i + sizeof(off_t), sizeof(size_t));
+		i += sizeof(off_t) + sizeof(size_t);
+		
+		pwrite_all(jrn->fd, jrn->pend + i, len, pos);
+		i += len;
+	}
+	
+	jrn->pend_len = 0;
+}
+
+void jrn_close(JRN * jrn)
+{
+	/* writes what's held back and marks the transaction done
+	 * once the file itself is on the disk */
+	
+	JRN_REC rec;
+	
+	jrn_sync(jrn);
+	fsync(jrn->fd);
+	
+	rec.type = JRN_END;
+	rec.txn = jrn->txn;
+	rec.off = rec.old_len = rec.new_len = 0;
+	jrn_put(jrn, &rec, NULL, 0);
+	jrn_flush(jrn);
+	
+	if (fclose(jrn->fp) != 0)
+	{
+		fprintf(stderr, "Err: journal write error.\n");
+		exit(1);
+	}
+	
+	free(jrn->name);
+	free(jrn->pend);
+}
+
+void jrn_put(JRN * jrn, const JRN_REC * rec, const void * data, size_t len)
+{
+	// appends a record and its data to the journal
+	if ((rec && fwrite(rec, sizeof(JRN_REC), 1, jrn->fp) != 1) || (len && fwrite(data, 1, len, jrn->fp) != len))
+	{
+		fprintf(stderr, "Err: journal write error.\n");
+		exit(1);
+	}
+}
+
+void jrn_flush(JRN * jrn)
+{
+	// puts everything appended so far on the disk
+	if (fflush(jrn->fp) != 0 || fsync(fileno(jrn->fp)) != 0)
+	{
+		fprintf(stderr, "Err: journal write error.\n");
+		exit(1);
+	}
+}
+
+size_t jrn_pread(int fd, byte * buff, size_t len, off_t pos)
+{
+	// reads up to len bytes at pos, less at the eof
+	size_t done = 0;
+	
+	while (done < len)
+	{
+		ssize_t n = pread(fd, buff + done, len - done, pos + done);
+		
+		if (n < 0 && EINTR == errno)
+			continue;
+		
+		if (n < 0)
+		{
+			fprintf(stderr, "Err: read error.\n");
+			exit(1);
+		}
+		
+		if (0 == n)
+			break;
+		done += n;
+	}
+	
+	return done;
+}
+
+byte * jrn_load(const char * name, size_t * len)
+{
+	/* reads a whole journal, NULL if there's none
+	 * a record cut short by a crash is left out of *len */
+	
+	FILE * fp = fopen(name, "rb");
+	byte * jbuff;
+	size_t cap = 0, i;
+	
+	*len = 0;
+	if (!fp)
+		return NULL;
+	
+	fseeko(fp, 0, SEEK_END);
+	cap = ftello(fp);
+	rewind(fp);
+	
+	if ( !(jbuff = (byte *)malloc(cap + 1)) || fread(jbuff, 1, cap, fp) != cap )
+	{
+		fprintf(stderr, "Err: can't read the journal %s.\n", name);
+		exit(1);
+	}
+	fclose(fp);
+	
+	if (cap < sizeof(JRN_MAGIC) - 1 || memcmp(jbuff, JRN_MAGIC, sizeof(JRN_MAGIC) - 1))
+	{
+		fprintf(stderr, "Err: %s isn't a journal.\n", name);
+		exit(1);
+	}
+	
+	for (i = sizeof(JRN_MAGIC) - 1; i + sizeof(JRN_REC) <= cap; ) 
+	{
+		JRN_REC rec;
+		
+		memcpy(&rec, jbuff + i, sizeof(JRN_REC));
+		if (rec.old_len + rec.new_len > cap - i - sizeof(JRN_REC))
+			break;
+		i += sizeof(JRN_REC) + rec.old_len + rec.new_len;
+	}
+	
+	*len = i;
+	return jbuff;
+}
+
+uint32_t jrn_last(const char * name, size_t * len)
+{
+	/* returns the number of the last transaction in a journal, 0 if there's none
+	 * and the length of its whole records in *len */
+	size_t i;
+	byte * jbuff = jrn_load(name, len);
+	uint32_t txn = 0;
+	
+	for (i = sizeof(JRN_MAGIC) - 1; jbuff && i < *len; ) 
+	{
+		JRN_REC rec;
+		
+		memcpy(&rec, jbuff + i, sizeof(JRN_REC));
+		if (JRN_BEGIN == rec.type)
+			txn = rec.txn;
+		i += sizeof(JRN_REC) + rec.old_len + rec.new_len;
+	}
+	
+	free(jbuff);
+	return txn;
+}
+
+void jrn_undo(const char * fname, bool redo)
+{
+	/* -undo puts back the old bytes of the last replace which isn't undone
+	 * -redo writes again the new bytes of the last undone one, as long as
+	 * no replace came after it; a replace cut short by a crash is undone too
+	 * the journal is replayed to tell which transactions are done:
+	 * a new replace makes the undone ones before it final */
+	
+	char * name = side_name(fname, JRN_EXT);
+	size_t len, i, * begin;
+	byte * jbuff = jrn_load(name, &len);
+	uint32_t * done, * undone, txn;
+	int n_done = 0, n_undone = 0, fd;
+	JRN_REC rec;
+	FILE * fp;
+	
+	if (!jbuff)
+	{
+		fprintf(stderr, "Err: no journal for %s.\n", fname);
+		exit(1);
+	}
+	
+	// transaction numbers are never more than the records
+	done = (uint32_t *)malloc(len * sizeof(uint32_t) / sizeof(JRN_REC) + 1);
+	undone = (uint32_t *)malloc(len * sizeof(uint32_t) / sizeof(JRN_REC) + 1);
+	begin = (size_t *)malloc((len / sizeof(JRN_REC) + 2) * sizeof(size_t));
+	if (!done || !undone || !begin)
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	for (i = sizeof(JRN_MAGIC) - 1; i < len; ) 
+	{
+		memcpy(&rec, jbuff + i, sizeof(JRN_REC));
+		
+		if (JRN_BEGIN == rec.type && rec.txn < len / sizeof(JRN_REC) + 2)
+		{
+			begin[rec.txn] = i;
+			done[n_done++] = rec.txn;
+			n_undone = 0;
+		}
+		else if (JRN_UNDO == rec.type && n_done > 0)
+			undone[n_undone++] = done[--n_done];
+		else if (JRN_REDO == rec.type && n_undone > 0)
+			done[n_done++] = undone[--n_undone];
+		
+		i += sizeof(JRN_REC) + rec.old_len + rec.new_len;
+	}
+	
+	if ((!redo && 0 == n_done) || (redo && 0 == n_undone))
+	{
+		fprintf(stderr, "Err: nothing to %s.\n", redo ? "redo" : "undo");
+		exit(1);
+	}
+	
+	txn = redo ? undone[n_undone - 1] : done[n_done - 1];
+	fp = open_file(fname, "rb+");
+	fd = fileno(fp);
+	
+	if (redo)
+	{
+		// forward, the new bytes
+		for (i = begin[txn]; i < len; i += sizeof(JRN_REC) + rec.old_len + rec.new_len) 
+		{
+			memcpy(&rec, jbuff + i, sizeof(JRN_REC));
+			if (JRN_WRITE == rec.type && txn == rec.txn)
+				pwrite_all(fd, jbuff + i + sizeof(JRN_REC) + rec.old_len, rec.new_len, rec.off);
+		}
+	}
+	else
+		jrn_revert(fd, jbuff, begin[txn], len, txn);
+	
+	fsync(fd);
+	
+	if (fclose(fp) != 0)
+	{
+		fprintf(stderr, "Err: write error.\n");
+		exit(1);
+	}
+	
+	// the journal says it's done only once it is
+	if ( !(fp = fopen(name, "ab")) )
+	{
+		fprintf(stderr, "Err: can't open the journal %s.\n", name);
+		exit(1);
+	}
+	
+	rec.type = redo ? JRN_REDO : JRN_UNDO;
+	rec.txn = txn;
+	rec.off = rec.old_len = rec.new_len = 0;
+	if (fwrite(&rec, sizeof(JRN_REC), 1, fp) != 1 || fflush(fp) != 0 || fsync(fileno(fp)) != 0 || fclose(fp) != 0)
+	{
+		fprintf(stderr, "Err: journal write error.\n");
+		exit(1);
+	}
+	
+	fprintf(stdout, "Replace %u %s.\n", txn, redo ? "redone" : "undone");
+	
+	free(done);
+	free(undone);
+	free(begin);
+	free(jbuff);
+	free(name);
+}
+
+void jrn_revert(int fd, const byte * jbuff, size_t from, size_t len, uint32_t txn)
+{
+	/* writes back the old bytes of txn, the last write first,
+	 * and cuts the file to its size before txn if it grew */
+	
+	JRN_REC rec, first;
+	size_t i, * at, n = 0;
+	off_t end = 0;
+	
+	if ( !(at = (size_t *)malloc((len / sizeof(JRN_REC) + 1) * sizeof(size_t))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	memcpy(&first, jbuff + from, sizeof(JRN_REC));
+	for (i = from; i < len; i += sizeof(JRN_REC) + rec.old_len + rec.new_len) 
+	{
+		memcpy(&rec, jbuff + i, sizeof(JRN_REC));
+		if (JRN_WRITE == rec.type && txn == rec.txn)
+		{
+			at[n++] = i;
+			if ((off_t)(rec.off + rec.new_len) > end)
+				end = rec.off + rec.new_len;
+		}
+	}
+	
+	while (n > 0)
+	{
+		i = at[--n];
+		memcpy(&rec, jbuff + i, sizeof(JRN_REC));
+		pwrite_all(fd, jbuff + i + sizeof(JRN_REC), rec.old_len, rec.off);
+	}
+	
+	if (end > (off_t)first.off && ftruncate(fd, first.off) != 0)
+	{
+		fprintf(stderr, "Err: can't truncate the file.\n");
+		exit(1);
+	}
+	
+	free(at);
+}
+
+void jrn_commit(const char * fname)
+{
+	// -commit keeps the changes and drops the journal, so they can't be undone anymore
+	char * name = side_name(fname, JRN_EXT);
+	
+	if (unlink(name) != 0)
+	{
+		fprintf(stderr, "Err: no journal for %s.\n", fname);
+		exit(1);
+	}
+	
+	fprintf(stdout, "Journal committed.\n");
+	free(name);
+}
+
+byte * seq_to_bytes(const char mode, const char * sequence, int * out_buff_size)
+{
+	/* converts a search or replace sequence to the bytes it stands for
+	 * returns a pointer to a buffer which must be freed, and writes down 
+	 * the buffer size at &out_buff_size */
+	
+	byte * byte_buff;
+	
+	if (BIN == mode)
+		return hexstr_to_bytes(sequence, out_buff_size);
+		
+	if (UNICODE == mode)
+		return str_to_enc(sequence, encoding, out_buff_size);
+	
+	*out_buff_size = strlen(sequence);
+	if ( !(byte_buff = (byte *)malloc(*out_buff_size + 1)) )
+	{
+		fprintf(stderr, "Err: unable to allocate byte buffer.\n");
+		exit(1);
+	}
+	memcpy(byte_buff, sequence, *out_buff_size);
+	
+	return byte_buff;
+}
+
+byte * str_to_enc(const char * str, int enc, int * out_buff_size)
+{
+	/* converts a UTF-8 string, which is what the terminal gives us,
+	 * to UTF-8, UTF-16LE or UTF-16BE bytes
+	 * returns a pointer to the buffer, and writes down 
+	 * the buffer size at &out_buff_size */
+	
+	const byte * p = (const byte *)str;
+	int str_len = strlen(str), j = 0;
+	byte * byte_buff;
+	
+	if (ENC_ALL == enc)
+	{
+		fprintf(stderr, "Err: -%c%c%s is for searching only.\n", SRCH, UNICODE, ENC_ALL_NAME);
+		exit(1);
+	}
+	
+	// UTF-16 takes at most 2 bytes for every UTF-8 byte
+	if (!(byte_buff = (byte *)malloc(str_len * 2 + 1)) )
+	{
+		fprintf(stderr, "Err: unable to allocate character buffer.\n");
+		exit(1);
+	}
+	
+	while (*p)
+	{
+		uint32_t cp;
+		int more, i;
+		
+		// the lead byte says how many continuation bytes follow
+		if (*p < 0x80)
+			cp = *p, more = 0;
+		else if ((*p & 0xE0) == 0xC0)
+			cp = *p & 0x1F, more = 1;
+		else if ((*p & 0xF0) == 0xE0)
+			cp = *p & 0x0F, more = 2;
+		else if ((*p & 0xF8) == 0xF0)
+			cp = *p & 0x07, more = 3;
+		else
+			goto bad_utf8;
+		
+		for (i = 1; i <= more; ++i) 
+		{
+			if ((p[i] & 0xC0) != 0x80)
+				goto bad_utf8;
+			cp = (cp << 6) | (p[i] & 0x3F);
+		}
+		
+		// overlong forms, surrogates and values past U+10FFFF aren't UTF-8
+		if ((1 == more && cp < 0x80) || (2 == more && cp < 0x800) || (3 == more && cp < 0x10000) ||
+		(cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+			goto bad_utf8;
+		
+		if (ENC_UTF8 == enc)
+			memcpy(byte_buff + j, p, more + 1), j += more + 1;
+		else
+		{
+			uint16_t units[2];
+			int n = 1, k;
+			
+			units[0] = cp;
+			if (cp >= 0x10000) // surrogate pair
+			{
+				units[0] = 0xD800 | ((cp - 0x10000) >> 10);
+				units[1] = 0xDC00 | ((cp - 0x10000) & 0x3FF);
+				n = 2;
+			}
+			
+			for (k = 0; k < n; ++k) 
+			{
+				byte_buff[j++] = (ENC_BE == enc) ? units[k] >> 8 : units[k] & 0xFF;
+				byte_buff[j++] = (ENC_BE == enc) ? units[k] & 0xFF : units[k] >> 8;
+			}
+		}
+		
+		p += more + 1;
+	}
+	
+	*out_buff_size = j; // save buffer size
+	return byte_buff;
+	
+	bad_utf8:
+		fprintf(stderr, "Err: \"%s\" isn't valid UTF-8.\n", str);
+		exit(1);
+}
+
+int get_encoding(const char * name)
+{
+	// turns what follows -su or -ru into an encoding
+	if ('\0' == name[0] || 0 == strcmp(name, "le"))
+		return ENC_LE;
+	if (0 == strcmp(name, "be"))
+		return ENC_BE;
+	if (0 == strcmp(name, "8"))
+		return ENC_UTF8;
+	if (0 == strcmp(name, ENC_ALL_NAME))
+		return ENC_ALL;
+	
+	fprintf(stderr, "Err: unknown encoding %s.\n", name);
+	exit(1);
+}
+
+byte * hexstr_to_bytes(const char * str, int * out_buff_size)
+{
+	/* converts a hex ASCII string to binary values
+	 * returns a pointer to the buffer with the values
+	 * and writes down the buffer size at &out_buff_size */
+	
+	int i, j, k;
+	char str_hex[strlen(str) + 1];
+	char ch;
+	byte * byte_buff;
+	
+	for (i = 0, j = 0; '\0' != str[i]; ++i) 
+	{
+		
+		ch = toupper(str[i]);
+		
+		// get only hex characters	
+		if (('0' <= ch && '9' >= ch) || ('A' <= ch && 'F' >= ch))
+			str_hex[j++] = ch;
+	}
+	
+	if (j % 2)
+	{
+		fprintf(stderr, "Err: odd number of hex digits.\n");
+		exit(1);
+	}
+	
+	str_hex[j] = '\0';
+	
+	// allocate buffer
+	if (!(byte_buff = (byte *)malloc(j)) )
+	{
+		fprintf(stderr, "Err: unable to allocate byte buffer.\n");
+		exit(1);
+	}
+	
+	// convert hex characters to binary values
+	for (i = 0, k = 0; i < j; i += 2, ++k) 
+		hex_chars_to_byte(&str_hex[i], &byte_buff[k]);
+
+	*out_buff_size = k; // save buffer size
+
+	return byte_buff;
+}
+
+void print_conv_nums(const char * str, int from_base, int to_base)
+{
+	// number conversion output
+	
+	unsigned long long number;
+	int i, j, k, l;
+	
+	i = strlen(str);
+	char clean_str[i + 1];
+	
+	// prepare a clean string for strtoull()
+	
+	if ('0' == str[0] && 'X' == toupper(str[1])) // skip 0x
+		str += 2;
+	
+	for (i = 0, l = 0, k = from_base - 1; '\0' != str[i]; ++i) 
+	{
+		j = toupper(str[i]);
+		
+		if (' ' == j) // skip spaces
+			continue;
+		
+		if ('0' <= j && '9' >= j)
+			j -= '0';
+		else if ('A' <= j && 'F' >= j)
+			j = (j - 'A') + MAGIC;
+			
+		/* check if the value derived from the character is > than 
+		 * the maximum single digit value of the requested base */
+		if (j > k)
+		{
+			fprintf(stderr, "Err: bad number.\n");
+			exit(1);
+		}
+		
+		clean_str[l++] = str[i];
+	}
+	clean_str[l] = '\0'; // end the string
+	
+	number = strtoull(clean_str, NULL, from_base); // convert it to a number
+	
+	// print original string
+	fprintf(stdout, "%s%s%s= %s", (16 == from_base) ? "0x" : "", str, (2 == from_base) ? "b " : " ",
+	(16 == to_base) ? "0x" : "");
+	
+	if (0 == number) // special case for binary zero
+	{
+		fprintf(stdout, "%d%c\n", 0, (2 == to_base) ? 'b' : ' ');
+		return;
+	}
+	
+	base_convert(number, to_base); // the actual conversion
+	
+	// print 'b' at the end if the conversion is to binary
+	fprintf(stdout, "%s\n", (2 == to_base) ? "\bb" : "");
+	
+	if (~0ULL == number)
+		fprintf(stdout, "Warning: maximum unsigned long long value is reached.\nMight be overflow.\n");
+}
+
+void base_convert(unsigned long long num, int base)
+{
+	/* converts numbers between bases <= 16 
+	 * using lookup tables */
+	
+	if (0 == num)
+		return;
+	else
+		/* if the base is 2 we still want to divide num by 16
+		 * since it will give us the offset in the binary table */
+		base_convert(num / ((2 != base) ? base : 16), base);
+	
+	// if the base is 2 look in the binary table
+	(2 == base) ? fprintf(stdout, "%s", BINTBL[num % 16]) : putchar(HEXTBL[num % base]);
+}
+
+void edit_open(int opt)
+{
+	// -e edits the file in memory before opt runs on it
+	if (!edits)
+		return;
+	
+	if ((OPT_DUMP != opt && OPT_WINDOWS != opt && OPT_SRCH != opt && OPT_FILE_INFO != opt && OPT_CSV != opt &&
+	OPT_SAVE != opt && OPT_DIFF != opt && OPT_HASH != opt && OPT_STATS != opt && OPT_STRINGS != opt) || replace_everything)
+	{
+		fprintf(stderr, "Err: -%c works with dumps, searches, -%c, -%c and %s only.\n", EDIT, DIFF, INFO, SAVE);
+		exit(1);
+	}
+	
+	view_open(&view, input_file, edits);
+}
+
+void view_open(VIEW * v, const char * fname, const char * list)
+{
+	/* maps fname read-only and applies the -e edits of list to a piece
+	 * table over it, so dumps, searches and -save see the edited file
+	 * while the file itself isn't touched; see src_open() */
+	
+	struct stat st;
+	const char * p = list;
+	
+	v->fname = fname;
+	v->fp = open_file(fname, "rb");
+	v->map = NULL;
+	v->add = NULL;
+	v->add_len = v->add_cap = 0;
+	v->pieces = NULL;
+	v->count = v->cap = 0;
+	
+	if (is_std(fname) || fstat(fileno(v->fp), &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		fprintf(stderr, "Err: -%c needs a regular file.\n", EDIT);
+		exit(1);
+	}
+	
+	v->size = st.st_size;
+	if (v->size > 0)
+	{
+		void * map = mmap(NULL, v->size, PROT_READ, MAP_PRIVATE, fileno(v->fp), 0);
+		
+		if (MAP_FAILED == map)
+		{
+			fprintf(stderr, "Err: can't map %s.\n", fname);
+			exit(1);
+		}
+		
+		v->map = (const byte *)map;
+		view_room(v);
+		v->pieces[v->count].start = 0;
+		v->pieces[v->count].len = v->size;
+		v->pieces[v->count++].is_add = false;
+	}
+	
+	// edits are made one after the other, so offsets are in the already edited file
+	while (*p)
+	{
+		char type = *p, * end;
+		off_t off = strtoll(p + 1, &end, 16);
+		
+		if ((EDIT_INS != type && EDIT_DEL != type && EDIT_OVR != type) || end == p + 1 || off > v->size ||
+		(EDIT_DEL == type && '+' != *end) || (EDIT_DEL != type && '=' != *end))
+		{
+			fprintf(stderr, "Err: bad edit %s.\n", p);
+			exit(1);
+		}
+		
+		if (EDIT_DEL == type)
+		{
+			off_t len = strtoll(end + 1, &end, 16);
+			
+			if (len <= 0 || len > v->size - off)
+			{
+				fprintf(stderr, "Err: bad edit %s.\n", p);
+				exit(1);
+			}
+			
+			view_delete(v, off, len);
+		}
+		else
+		{
+			const char * q = end + 1;
+			char * hex;
+			byte * bytes;
+			int len;
+			
+			end = strchr(q, ',');
+			if (!end)
+				end = (char *)q + strlen(q);
+			
+			if ( !(hex = strndup(q, end - q)) )
+			{
+				fprintf(stderr, "Err: memory allocation failed.\n");
+				exit(1);
+			}
+			
+			bytes = hexstr_to_bytes(hex, &len);
+			
+			// an overwrite can run past the end and grow the file
+			if (EDIT_OVR == type)
+				view_delete(v, off, (len < v->size - off) ? len : v->size - off);
+			view_insert(v, off, bytes, len);
+			
+			free(bytes);
+			free(hex);
+		}
+		
+		p = (',' == *end) ? end + 1 : end;
+	}
+	
+	edit_view = v;
+	idx_never = true;
+}
+
+void view_room(VIEW * v)
+{
+	// makes room for one more piece
+	if (v->count == v->cap)
+	{
+		v->cap = v->cap ? v->cap * 2 : 64;
+		if ( !(v->pieces = (PIECE *)realloc(v->pieces, v->cap * sizeof(PIECE))) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+	}
+}
+
+int view_split(VIEW * v, off_t off)
+{
+	// returns the index of the piece which starts at off, splitting the one off falls in
+	off_t at = 0;
+	int i;
+	
+	for (i = 0; i < v->count; at += v->pieces[i].len, ++i) 
+	{
+		if (at == off)
+			return i;
+		
+		if (off < at + v->pieces[i].len)
+		{
+			view_room(v);
+			memmove(&v->pieces[i + 2], &v->pieces[i + 1], (v->count - i - 1) * sizeof(PIECE));
+			v->pieces[i + 1] = v->pieces[i];
+			v->pieces[i].len = off - at;
+			v->pieces[i + 1].start += off - at;
+			v->pieces[i + 1].len -= off - at;
+			++v->count;
+			return i + 1;
+		}
+	}
+	
+	return v->count;
+}
+
+void view_insert(VIEW * v, off_t off, const byte * bytes, size_t len)
+{
+	// puts len bytes at off, they go in the add buffer
+	int i;
+	
+	if (0 == len)
+		return;
+	
+	if (v->add_len + len > v->add_cap)
+	{
+		v->add_cap = (v->add_len + len) * 2;
+		if ( !(v->add = (byte *)realloc(v->add, v->add_cap)) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+	}
+	
+	memcpy(v->add + v->add_len, bytes, len);
+	
+	i = view_split(v, off);
+	view_room(v);
+	memmove(&v->pieces[i + 1], &v->pieces[i], (v->count - i) * sizeof(PIECE));
+	v->pieces[i].start = v->add_len;
+	v->pieces[i].len = len;
+	v->pieces[i].is_add = true;
+	++v->count;
+	
+	v->add_len += len;
+	v->size += len;
+}
+
+void view_delete(VIEW * v, off_t off, off_t len)
+{
+	// takes out len bytes from off
+	int i, j;
+	
+	if (0 == len)
+		return;
+	
+	i = view_split(v, off);
+	j = view_split(v, off + len);
+	
+	memmove(&v->pieces[i], &v->pieces[j], (v->count - j) * sizeof(PIECE));
+	v->count -= j - i;
+	v->size -= len;
+}
+
+size_t view_read(const VIEW * v, byte * buff, size_t len, off_t pos)
+{
+	// copies up to len bytes from pos, less at the end
+	off_t at = 0;
+	size_t done = 0;
+	int i;
+	
+	for (i = 0; i < v->count && done < len; at += v->pieces[i].len, ++i) 
+	{
+		const PIECE * pc = &v->pieces[i];
+		off_t from = pos + done - at;
+		size_t n;
+		
+		if (from >= pc->len)
+			continue;
+		
+		n = (pc->len - from < (off_t)(len - done)) ? pc->len - from : len - done;
+		memcpy(buff + done, (pc->is_add ? v->add : v->map) + pc->start + from, n);
+		done += n;
+	}
+	
+	return done;
+}
+
+void view_save(const VIEW * v, const char * fname)
+{
+	/* -save writes the edited file to fname
+	 * the pieces of the original file are copied by the kernel with
+	 * copy_file_range(), which can share the extents and skips user space,
+	 * or from the mapping where it can't; only the added bytes are written */
+	
+	struct stat st_in, st_out;
+	long long copied = 0, added = 0;
+	int fd_in = fileno(v->fp), fd, i;
+	
+	if (fstat(fd_in, &st_in) != 0 || 
+	(0 == stat(fname, &st_out) && st_in.st_dev == st_out.st_dev && st_in.st_ino == st_out.st_ino))
+	{
+		fprintf(stderr, "Err: can't save %s over itself.\n", v->fname);
+		exit(1);
+	}
+	
+	if ((fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+	{
+		fprintf(stderr, "Couldn't open file %s\n", fname);
+		exit(1);
+	}
+	
+	for (i = 0; i < v->count; ++i) 
+	{
+		const PIECE * pc = &v->pieces[i];
+		off_t in = pc->start, left = pc->len;
+		
+		if (pc->is_add)
+		{
+			write_all(fd, (const char *)v->add + pc->start, pc->len);
+			added += pc->len;
+			continue;
+		}
+		
+		while (left > 0)
+		{
+			ssize_t n = copy_file_range(fd_in, &in, fd, NULL, left, 0);
+			
+			if (n < 0 && EINTR == errno)
+				continue;
+			
+			// another file system, or a kernel without it
+			if (n <= 0)
+			{
+				write_all(fd, (const char *)v->map + in, left);
+				break;
+			}
+			left -= n;
+		}
+		
+		copied += pc->len;
+	}
+	
+	if (close(fd) != 0)
+	{
+		fprintf(stderr, "Err: write error.\n");
+		exit(1);
+	}
+	
+	fprintf(stdout, "%lld bytes saved to %s, %lld copied from %s and %lld added.\n", copied + added, fname, 
+	copied, v->fname, added);
+}
+
+static inline uint32_t delta_slot(uint32_t h, int bits)
+{
+	// spreads a rolling hash over a table of 1 << bits
+	return (h * 2654435761u) >> (32 - bits);
+}
+
+void delta_make(const char * fold, const char * fnew, const char * fpatch)
+{
+	/* -mkpatch writes the ops which make fnew out of fold to fpatch:
+	 * copies of fold ranges and the bytes found nowhere in fold
+	 * every DELTA_BLK bytes of fold are hashed into a table, then a
+	 * rolling hash of a window of fnew is looked up at every byte,
+	 * so blocks are found wherever they moved; a found block is
+	 * grown both ways to the whole matching run */
+	
+	SRC src_old, src_new;
+	OUT out;
+	FILE * fpout;
+	DELTA_HDR hdr;
+	const byte * old, * new;
+	uint32_t pow_blk = 1, h = 0;
+	uint64_t * table = NULL, * seen = NULL;
+	off_t size_old, size_new, blk = DELTA_BLK, p, add = 0, last = 0, blocks, i;
+	long long copied = 0, added = 0, copies = 0;
+	int bits = 10;
+	
+	// both files are read at random, so they're always mapped
+	map_force = true;
+	src_open(&src_old, fold);
+	src_open(&src_new, fnew);
+	
+	if ((size_old = src_size(&src_old)) < 0 || (size_new = src_size(&src_new)) < 0 || 
+	(size_old > 0 && !src_old.map) || (size_new > 0 && !src_new.map))
+	{
+		fprintf(stderr, "Err: %s needs regular files.\n", MKPATCH);
+		exit(1);
+	}
+	old = src_old.map;
+	new = src_new.map;
+	
+	// bigger blocks keep the table of a big file under DELTA_BLOCKS entries
+	while (size_old / blk > DELTA_BLOCKS)
+		blk *= 2;
+	blocks = size_old / blk;
+	while ((1LL << bits) < blocks * 4)
+		++bits;
+	
+	if ( !(table = (uint64_t *)calloc(1ULL << bits, sizeof(uint64_t))) || 
+	!(seen = (uint64_t *)calloc(((1ULL << bits) + 63) / 64, sizeof(uint64_t))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	for (i = 0; i < blk; ++i) 
+		pow_blk *= DELTA_MUL;
+	
+	/* a slot has the hash in the high half and the block + 1 in the low one,
+	 * so only a block with the same hash is compared; the first of equal
+	 * blocks is kept, and seen has a bit for every slot in use */
+	for (i = blocks - 1; i >= 0; --i) 
+	{
+		uint32_t bh = delta_hash(old + i * blk, blk), slot = delta_slot(bh, bits);
+		
+		table[slot] = ((uint64_t)bh << 32) | (uint64_t)(i + 1);
+		seen[slot / 64] |= 1ULL << (slot % 64);
+	}
+	
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DELTA_MAGIC, sizeof(hdr.magic));
+	hdr.old_size = size_old;
+	hdr.new_size = size_new;
+	hdr.old_crc = crc32_update(0, old, size_old);
+	hdr.new_crc = crc32_update(0, new, size_new);
+	
+	fpout = open_file(fpatch, "wb");
+	out_open(&out, fileno(fpout));
+	out_write(&out, &hdr, sizeof(hdr));
+	
+	if (size_new >= blk && blocks > 0)
+		h = delta_hash(new, blk);
+	
+	for (p = 0; blocks > 0 && p + blk <= size_new; ) 
+	{
+		uint32_t slot = delta_slot(h, bits);
+		
+		if ((seen[slot / 64] & (1ULL << (slot % 64))) && h == table[slot] >> 32)
+		{
+			off_t o = (off_t)((table[slot] & 0xFFFFFFFFu) - 1) * blk, back = 0, len;
+			
+			if (0 == memcmp(old + o, new + p, blk))
+			{
+				off_t most = (size_old - o < size_new - p) ? size_old - o : size_new - p;
+				
+				while (back < p - add && back < o && old[o - back - 1] == new[p - back - 1])
+					++back;
+				len = blk + diff_first(old + o + blk, new + p + blk, most - blk);
+				
+				if (p - back > add)
+				{
+					delta_op(&out, DELTA_ADD, p - back - add, 0);
+					out_write(&out, new + add, p - back - add);
+					added += p - back - add;
+				}
+				
+				delta_op(&out, DELTA_COPY, o - back - last, len + back);
+				last = o + len;
+				copied += len + back;
+				++copies;
+				
+				p += len;
+				add = p;
+				if (p + blk <= size_new)
+					h = delta_hash(new + p, blk);
+				continue;
+			}
+		}
+		
+		if (p + blk < size_new)
+			h = h * DELTA_MUL + new[p + blk] - new[p] * pow_blk;
+		++p;
+	}
+	
+	if (size_new > add)
+	{
+		delta_op(&out, DELTA_ADD, size_new - add, 0);
+		out_write(&out, new + add, size_new - add);
+		added += size_new - add;
+	}
+	
+	delta_op(&out, DELTA_END, 0, 0);
+	out_close(&out);
+	
+	// stdout might be the patch itself
+	fprintf(is_std(fpatch) ? stderr : stdout, "%s was written successfully, %lld bytes copied in %lld ops and %lld added.\n", 
+	fpatch, copied, copies, added);
+	
+	if (fclose(fpout) != 0)
+	{
+		fprintf(stderr, "Err: write error. Writing to %s has failed.\n", fpatch);
+		exit(1);
+	}
+	
+	free(table);
+	free(seen);
+	src_close(&src_old);
+	src_close(&src_new);
+}
+
+void delta_apply(const char * fold, const char * fpatch, const char * fnew)
+{
+	/* -apply makes fnew from fold and the ops of fpatch, which is read
+	 * as a stream, so it can be a pipe; both files are checked with
+	 * their crc32 from the patch header */
+	
+	SRC src;
+	OUT out;
+	FILE * fp, * fpout;
+	DELTA_HDR hdr;
+	struct stat st_old, st_new;
+	const byte * data;
+	uint32_t crc = 0;
+	off_t size, last = 0, done = 0;
+	size_t n;
+	int type;
+	bool ok = true;
+	
+	src_open(&src, fold);
+	fp = open_file(fpatch, "rb");
+	
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, DELTA_MAGIC, sizeof(hdr.magic)) != 0)
+	{
+		fprintf(stderr, "Err: %s isn't a patch.\n", fpatch);
+		exit(1);
+	}
+	
+	// the patch is made for one file only
+	if ((size = src_size(&src)) < 0 || (uint64_t)size != hdr.old_size)
+	{
+		fprintf(stderr, "Err: %s isn't the file the patch was made from.\n", fold);
+		exit(1);
+	}
+	
+	while ((n = src_next(&src, 0, &data)) > 0)
+		crc = crc32_update(crc, data, n);
+	
+	if (crc != hdr.old_crc)
+	{
+		fprintf(stderr, "Err: %s isn't the file the patch was made from.\n", fold);
+		exit(1);
+	}
+	
+	if (!is_std(fnew) && 0 == stat(fnew, &st_new) && 0 == fstat(fileno(src.fp), &st_old) && 
+	st_old.st_dev == st_new.st_dev && st_old.st_ino == st_new.st_ino)
+	{
+		fprintf(stderr, "Err: can't apply %s over %s itself.\n", fpatch, fold);
+		exit(1);
+	}
+	
+	fpout = open_file(fnew, "wb");
+	out_open(&out, fileno(fpout));
+	crc = 0;
+	
+	// a damaged patch stops the loop, the check after it removes fnew
+	while (ok && (type = getc(fp)) != DELTA_END)
+	{
+		uint64_t a, len = 0;
+		
+		ok = delta_varint(fp, &a) && (DELTA_ADD == type || delta_varint(fp, &len));
+		
+		if (DELTA_ADD == type)
+			len = a;
+		else if (DELTA_COPY == type)
+		{
+			// offsets are zigzag deltas from the end of the last copy
+			last += (off_t)(a >> 1) ^ -(off_t)(a & 1);
+			ok = ok && last >= 0 && last <= size && len <= (uint64_t)(size - last);
+		}
+		else
+			ok = false;
+		
+		ok = ok && len <= hdr.new_size - done;
+		
+		// both go straight to the output buffer
+		while (ok && len > 0)
+		{
+			size_t part = (len < OUT_SIZE) ? len : OUT_SIZE;
+			byte * to = (byte *)out_reserve(&out, part);
+			
+			if (DELTA_COPY == type)
+			{
+				if (src.map)
+					memcpy(to, src.map + last, part);
+				else if (src_pread(&src, to, part, last) != part)
+				{
+					fprintf(stderr, "Err: read error.\n");
+					exit(1);
+				}
+				last += part;
+			}
+			else if (fread(to, 1, part, fp) != part)
+			{
+				ok = false;
+				break;
+			}
+			
+			crc = crc32_update(crc, to, part);
+			out.len += part;
+			done += part;
+			len -= part;
+		}
+	}
+	
+	out_close(&out);
+	
+	if (!ok || (uint64_t)done != hdr.new_size || crc != hdr.new_crc)
+	{
+		fprintf(stderr, "Err: %s is damaged.\n", fpatch);
+		if (!is_std(fnew))
+			remove(fnew);
+		exit(1);
+	}
+	
+	// stdout might be the new file itself
+	fprintf(is_std(fnew) ? stderr : stdout, "%s was written successfully.\n", fnew);
+	
+	if (fclose(fpout) != 0)
+	{
+		fprintf(stderr, "Err: write error. Writing to %s has failed.\n", fnew);
+		exit(1);
+	}
+	
+	if (fp != stdin)
+		fclose(fp);
+	src_close(&src);
+}
+
+void delta_op(OUT * out, int type, uint64_t a, uint64_t b)
+{
+	// writes an op, a copy has a zigzag offset delta in a and a length in b, an add its length in a
+	byte op[1 + 10 * 2];
+	int len = 0;
+	
+	op[len++] = (byte)type;
+	
+	if (DELTA_END != type)
+	{
+		if (DELTA_COPY == type)
+			a = (a << 1) ^ (uint64_t)((int64_t)a >> 63);
+		
+		for (; a >= 0x80; a >>= 7) 
+			op[len++] = (byte)(a | 0x80);
+		op[len++] = (byte)a;
+	}
+	
+	if (DELTA_COPY == type)
+	{
+		for (; b >= 0x80; b >>= 7) 
+			op[len++] = (byte)(b | 0x80);
+		op[len++] = (byte)b;
+	}
+	
+	out_write(out, op, len);
+}
+
+bool delta_varint(FILE * fp, uint64_t * val)
+{
+	// reads a varint of a patch, false if it's cut or too long
+	int c, shift;
+	
+	*val = 0;
+	for (shift = 0; shift < 64 && (c = getc(fp)) != EOF; shift += 7) 
+	{
+		*val |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	
+	return false;
+}
+
+uint32_t delta_hash(const byte * data, off_t len)
+{
+	// the rolling hash of delta_make() for len bytes from scratch
+	uint32_t h = 0;
+	off_t i;
+	
+	for (i = 0; i < len; ++i) 
+		h = h * DELTA_MUL + data[i];
+	
+	return h;
+}
+
+void hash_file(const char * fname, int algs)
+{
+	/* -H hashes the bytes a dump with the same -o and -l would show with
+	 * every algorithm of algs in one pass, the data is fed to all of them
+	 * HASH_PIECE bytes at a time while it's in the cache
+	 * with -j the crcs and adler32 of a regular file are split between
+	 * the threads and combined, xxh64 and sha256 get a thread each */
+	
+	SRC src;
+	HASH_CTX ctx;
+	off_t file_end, len;
+	
+	src_open(&src, fname);
+	file_end = dump_range(&src, &len);
+	
+	crc_tables();
+	hash_init(&ctx, algs);
+	
+	if (jobs > 1 && file_end >= 0 && len >= HASH_PAR_MIN)
+		hash_parallel(&src, offset, len, &ctx);
+	else
+	{
+		const byte * data;
+		off_t done = 0;
+		size_t n;
+		
+		src_seek(&src, offset);
+		while ((len < 0 || done < len) && (n = src_next(&src, 0, &data)) > 0)
+		{
+			if (len >= 0 && (off_t)n > len - done)
+				n = len - done;
+			hash_update(&ctx, data, n);
+			done += n;
+		}
+		len = done;
+	}
+	
+	fprintf(stdout, "%-8s %#llx - %#llx, %lld bytes\n", "Range:", (unsigned long long)offset, 
+	(unsigned long long)(offset + len - (len > 0)), (long long)len);
+	hash_print(&ctx);
+	
+	src_close(&src);
+}
+
+off_t dump_range(SRC * src, off_t * len)
+{
+	/* moves offset to where a dump with -o and -l would start and sets len
+	 * to the bytes it would show, -1 up to the end of a pipe
+	 * returns the size of the file, -1 for a pipe */
+	off_t file_end;
+	
+	if (hex_dump_middle) // -lm
+	{
+		offset -= line_num * MAX;
+		line_num = line_num * 2 + 1;
+	}
+	else if (negative_line) // -l -<line num>
+		offset -= line_num * MAX;
+	
+	if (0 > offset)
+	{
+		fprintf(stderr, "Err: negative offset.\n");
+		exit(1);
+	}
+	
+	*len = (line_num > 0) ? line_num * MAX : -1;
+	
+	if ((file_end = src_size(src)) >= 0)
+	{
+		if (offset > file_end)
+			offset = file_end;
+		if (*len < 0 || *len > file_end - offset)
+			*len = file_end - offset;
+	}
+	
+	return file_end;
+}
+
+int hash_parse(const char * list)
+{
+	// turns a list like "crc32,sha256" into HASH_ flags
+	int algs = 0;
+	
+	while (*list)
+	{
+		size_t len = strcspn(list, ",");
+		int i;
+		
+		for (i = 0; i < HASH_ALGS; ++i) 
+		{
+			if (strlen(HASH_NAME[i]) == len && 0 == strncasecmp(list, HASH_NAME[i], len))
+				break;
+		}
+		
+		if (HASH_ALGS == i)
+		{
+			fprintf(stderr, "Err: unknown hash %.*s.\n", (int)len, list);
+			exit(1);
+		}
+		
+		algs |= 1 << i;
+		list += len + (',' == list[len]);
+	}
+	
+	return algs;
+}
+
+void hash_init(HASH_CTX * ctx, int algs)
+{
+	// starts every algorithm in algs
+	ctx->algs = algs;
+	ctx->crc32 = 0;
+	ctx->crc32c = 0;
+	ctx->adler = 1;
+	xxh64_init(&ctx->xxh);
+	sha256_init(&ctx->sha);
+}
+
+void hash_update(HASH_CTX * ctx, const byte * data, size_t len)
+{
+	// feeds len bytes to every algorithm of ctx, a piece at a time
+	while (len > 0)
+	{
+		size_t n = (len < HASH_PIECE) ? len : HASH_PIECE;
+		
+		if (ctx->algs & HASH_CRC32)
+			ctx->crc32 = crc32_update(ctx->crc32, data, n);
+		if (ctx->algs & HASH_CRC32C)
+			ctx->crc32c = crc32c_update(ctx->crc32c, data, n);
+		if (ctx->algs & HASH_ADLER)
+			ctx->adler = adler32_update(ctx->adler, data, n);
+		if (ctx->algs & HASH_XXH64)
+			xxh64_update(&ctx->xxh, data, n);
+		if (ctx->algs & HASH_SHA256)
+			sha256_update(&ctx->sha, data, n);
+		
+		data += n;
+		len -= n;
+	}
+}
+
+void hash_print(HASH_CTX * ctx)
+{
+	// finishes and prints every algorithm of ctx
+	if (ctx->algs & HASH_CRC32)
+		fprintf(stdout, "%-8s %08x\n", "CRC32:", ctx->crc32);
+	if (ctx->algs & HASH_CRC32C)
+		fprintf(stdout, "%-8s %08x\n", "CRC32C:", ctx->crc32c);
+	if (ctx->algs & HASH_ADLER)
+		fprintf(stdout, "%-8s %08x\n", "Adler32:", ctx->adler);
+	if (ctx->algs & HASH_XXH64)
+		fprintf(stdout, "%-8s %016llx\n", "XXH64:", (unsigned long long)xxh64_final(&ctx->xxh));
+	if (ctx->algs & HASH_SHA256)
+	{
+		byte digest[32];
+		int i;
+		
+		sha256_final(&ctx->sha, digest);
+		fprintf(stdout, "%-8s ", "SHA256:");
+		for (i = 0; i < 32; ++i) 
+			fprintf(stdout, "%02x", digest[i]);
+		fprintf(stdout, "\n");
+	}
+}
+
+void hash_parallel(SRC * src, off_t start, off_t len, HASH_CTX * ctx)
+{
+	/* the crcs and adler32 can be combined from the ones of their parts,
+	 * so the range is split between what's left of the threads after
+	 * xxh64 and sha256, which have to go through the range in order */
+	
+	HASH_JOB job_arr[MAX_JOBS];
+	int split = ctx->algs & (HASH_CRC32 | HASH_CRC32C | HASH_ADLER);
+	int n = 0, parts = 0, i;
+	
+	if (ctx->algs & HASH_XXH64)
+		hash_job_set(&job_arr[n++], src, start, len, HASH_XXH64);
+	if (ctx->algs & HASH_SHA256)
+		hash_job_set(&job_arr[n++], src, start, len, HASH_SHA256);
+	
+	if (split)
+	{
+		off_t part;
+		
+		parts = (jobs - n > 1) ? jobs - n : 1;
+		part = (len / parts + HASH_PIECE - 1) / HASH_PIECE * HASH_PIECE;
+		
+		for (i = 0; i < parts && i * part < len; ++i) 
+			hash_job_set(&job_arr[n++], src, start + i * part, (len - i * part < part) ? len - i * part : part, split);
+		parts = i;
+	}
+	
+	run_jobs(hash_job, job_arr, sizeof(HASH_JOB), n);
+	
+	for (i = 0; i < n; ++i) 
+	{
+		HASH_CTX * job = &job_arr[i].ctx;
+		
+		if (job->algs & HASH_XXH64)
+			ctx->xxh = job->xxh;
+		if (job->algs & HASH_SHA256)
+			ctx->sha = job->sha;
+		
+		// the parts are in order
+		if (job->algs & HASH_CRC32)
+			ctx->crc32 = crc_combine(ctx->crc32, job->crc32, job_arr[i].len, CRC32_POLY);
+		if (job->algs & HASH_CRC32C)
+			ctx->crc32c = crc_combine(ctx->crc32c, job->crc32c, job_arr[i].len, CRC32C_POLY);
+		if (job->algs & HASH_ADLER)
+			ctx->adler = adler32_combine(ctx->adler, job->adler, job_arr[i].len);
+		
+		free(job_arr[i].buff);
+	}
+}
+
+void hash_job_set(HASH_JOB * job, const SRC * src, off_t start, off_t len, int algs)
+{
+	// sets up one job of hash_parallel()
+	job->src = src;
+	job->start = start;
+	job->len = len;
+	job->buff = NULL;
+	hash_init(&job->ctx, algs);
+}
+
+void * hash_job(void * arg)
+{
+	// hashes the range of one job, from the map or with pread()
+	HASH_JOB * job = (HASH_JOB *)arg;
+	off_t done;
+	
+	if (job->src->map)
+	{
+		hash_update(&job->ctx, job->src->map + job->start, job->len);
+		return NULL;
+	}
+	
+	if ( !(job->buff = (byte *)malloc(BLK_SIZE)) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	for (done = 0; done < job->len; ) 
+	{
+		size_t n = (job->len - done < BLK_SIZE) ? job->len - done : BLK_SIZE;
+		
+		if (src_pread(job->src, job->buff, n, job->start + done) != n)
+		{
+			fprintf(stderr, "Err: read error.\n");
+			exit(1);
+		}
+		
+		hash_update(&job->ctx, job->buff, n);
+		done += n;
+	}
+	
+	return NULL;
+}
+
+void crc_tables(void)
+{
+	/* builds the slicing by 8 tables of crc32 and crc32c on the first call,
+	 * before any thread needs them */
+	static bool is_init = false;
+	int i, j;
+	
+	if (is_init)
+		return;
+	
+	for (i = 0; i < 256; ++i) 
+	{
+		uint32_t c = i, cc = i;
+		
+		for (j = 0; j < 8; ++j) 
+		{
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+			cc = (cc & 1) ? (cc >> 1) ^ CRC32C_POLY : cc >> 1;
+		}
+		crc32_table[0][i] = c;
+		crc32c_table[0][i] = cc;
+	}
+	
+	for (i = 0; i < 256; ++i) 
+	{
+		for (j = 1; j < 8; ++j) 
+		{
+			crc32_table[j][i] = (crc32_table[j - 1][i] >> 8) ^ crc32_table[0][crc32_table[j - 1][i] & 0xFF];
+			crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[j - 1][i] & 0xFF];
+		}
+	}
+	
+	is_init = true;
+}
+
+uint32_t crc_slice8(uint32_t table[][256], uint32_t crc, const byte * data, size_t len)
+{
+	// the table driven crc, 8 bytes at a time, on the inverted crc
+	size_t i;
+	
+	for (i = 0; i + 8 <= len; i += 8) 
+	{
+		uint32_t lo = crc ^ ((uint32_t)data[i] | (uint32_t)data[i + 1] << 8 | (uint32_t)data[i + 2] << 16 | (uint32_t)data[i + 3] << 24);
+		
+		crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+		table[3][data[i + 4]] ^ table[2][data[i + 5]] ^ table[1][data[i + 6]] ^ table[0][data[i + 7]];
+	}
+	
+	for (; i < len; ++i) 
+		crc = (crc >> 8) ^ table[0][(crc ^ data[i]) & 0xFF];
+	
+	return crc;
+}
+
+uint32_t crc32_update(uint32_t crc, const byte * data, size_t len)
+{
+	// the crc32 of zip and png, continued from crc over len more bytes
+	crc_tables();
+	crc = ~crc;
+	
+#ifdef X86_SIMD
+	// carry-less multiplication folds 64 bytes at a time
+	if (len >= 64 && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+	{
+		size_t n = len & ~(size_t)15;
+		
+		crc = crc32_pclmul(data, n, crc);
+		data += n;
+		len -= n;
+	}
+#endif
+	
+	return ~crc_slice8(crc32_table, crc, data, len);
+}
+
+uint32_t crc32c_update(uint32_t crc, const byte * data, size_t len)
+{
+	// the crc32c of iscsi and ext4, the crc32 instruction of sse4.2 computes it
+	crc_tables();
+	crc = ~crc;
+	
+#ifdef X86_SIMD
+	if (__builtin_cpu_supports("sse4.2"))
+		return ~crc32c_sse42(data, len, crc);
+#endif
+	
+	return ~crc_slice8(crc32c_table, crc, data, len);
+}
+
+static uint32_t gf2_times(const uint32_t * mat, uint32_t vec)
+{
+	// multiplies vec by a 32 x 32 matrix over GF(2)
+	uint32_t sum = 0;
+	
+	for (; vec; vec >>= 1, ++mat) 
+		if (vec & 1)
+			sum ^= *mat;
+	
+	return sum;
+}
+
+static void gf2_square(uint32_t * sq, const uint32_t * mat)
+{
+	// sq is mat times mat
+	int i;
+	
+	for (i = 0; i < 32; ++i) 
+		sq[i] = gf2_times(mat, mat[i]);
+}
+
+uint32_t crc_combine(uint32_t crc1, uint32_t crc2, uint64_t len2, uint32_t poly)
+{
+	/* returns the crc of two parts from the crcs of both and the length of
+	 * the second one, like crc32_combine() of zlib: crc1 is moved past len2
+	 * zero bytes by squaring the matrix of one zero bit */
+	uint32_t even[32], odd[32], row = 1;
+	int i;
+	
+	if (0 == len2)
+		return crc1;
+	
+	odd[0] = poly;
+	for (i = 1; i < 32; ++i, row <<= 1) 
+		odd[i] = row;
+	
+	gf2_square(even, odd);	// 2 zero bits
+	gf2_square(odd, even);	// 4 zero bits
+	
+	while (true)
+	{
+		gf2_square(even, odd);
+		if (len2 & 1)
+			crc1 = gf2_times(even, crc1);
+		if (0 == (len2 >>= 1))
+			break;
+		
+		gf2_square(odd, even);
+		if (len2 & 1)
+			crc1 = gf2_times(odd, crc1);
+		if (0 == (len2 >>= 1))
+			break;
+	}
+	
+	return crc1 ^ crc2;
+}
+
+uint32_t adler32_update(uint32_t adler, const byte * data, size_t len)
+{
+	// the adler32 of zlib, the sums are reduced once every ADLER_NMAX bytes
+	uint32_t a = adler & 0xFFFF, b = adler >> 16;
+	
+	while (len > 0)
+	{
+		size_t n = (len < ADLER_NMAX) ? len : ADLER_NMAX, i;
+		
+		for (i = 0; i + 4 <= n; i += 4) 
+		{
+			a += data[i];
+			b += a;
+			a += data[i + 1];
+			b += a;
+			a += data[i + 2];
+			b += a;
+			a += data[i + 3];
+			b += a;
+		}
+		
+		for (; i < n; ++i) 
+		{
+			a += data[i];
+			b += a;
+		}
+		
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+		data += n;
+		len -= n;
+	}
+	
+	return (b << 16) | a;
+}
+
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2)
+{
+	// the adler32 of two parts, like adler32_combine() of zlib
+	uint32_t rem = len2 % ADLER_BASE;
+	uint32_t a = adler1 & 0xFFFF;
+	uint32_t b = (uint32_t)(((uint64_t)rem * a) % ADLER_BASE);
+	
+	a += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+	b += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - rem;
+	
+	if (a >= ADLER_BASE)
+		a -= ADLER_BASE;
+	if (a >= ADLER_BASE)
+		a -= ADLER_BASE;
+	if (b >= ADLER_BASE * 2)
+		b -= ADLER_BASE * 2;
+	if (b >= ADLER_BASE)
+		b -= ADLER_BASE;
+	
+	return (b << 16) | a;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t in)
+{
+	// one lane step of xxh64
+	acc += in * XXH_P2;
+	acc = (acc << 31) | (acc >> 33);
+	return acc * XXH_P1;
+}
+
+void xxh64_init(XXH64_CTX * ctx)
+{
+	// xxh64 with seed 0
+	ctx->v[0] = XXH_P1 + XXH_P2;
+	ctx->v[1] = XXH_P2;
+	ctx->v[2] = 0;
+	ctx->v[3] = -XXH_P1;
+	ctx->len = 0;
+	ctx->total = 0;
+}
+
+void xxh64_update(XXH64_CTX * ctx, const byte * data, size_t len)
+{
+	// goes through 32 byte stripes, a part of one waits in ctx->buff
+	uint64_t lane[4];
+	int i;
+	
+	ctx->total += len;
+	
+	if (ctx->len > 0)
+	{
+		size_t n = (len < 32 - ctx->len) ? len : 32 - ctx->len;
+		
+		memcpy(ctx->buff + ctx->len, data, n);
+		ctx->len += n;
+		data += n;
+		len -= n;
+		
+		if (ctx->len < 32)
+			return;
+		
+		memcpy(lane, ctx->buff, 32);
+		for (i = 0; i < 4; ++i) 
+			ctx->v[i] = xxh64_round(ctx->v[i], lane[i]);
+		ctx->len = 0;
+	}
+	
+	for (; len >= 32; data += 32, len -= 32) 
+	{
+		memcpy(lane, data, 32);
+		ctx->v[0] = xxh64_round(ctx->v[0], lane[0]);
+		ctx->v[1] = xxh64_round(ctx->v[1], lane[1]);
+		ctx->v[2] = xxh64_round(ctx->v[2], lane[2]);
+		ctx->v[3] = xxh64_round(ctx->v[3], lane[3]);
+	}
+	
+	memcpy(ctx->buff, data, len);
+	ctx->len = len;
+}
+
+uint64_t xxh64_final(const XXH64_CTX * ctx)
+{
+	// merges the lanes and mixes in the bytes left
+	uint64_t h;
+	size_t i;
+	int j;
+	
+	if (ctx->total >= 32)
+	{
+		h = ((ctx->v[0] << 1) | (ctx->v[0] >> 63)) + ((ctx->v[1] << 7) | (ctx->v[1] >> 57)) + 
+		((ctx->v[2] << 12) | (ctx->v[2] >> 52)) + ((ctx->v[3] << 18) | (ctx->v[3] >> 46));
+		
+		for (j = 0; j < 4; ++j) 
+			h = (h ^ xxh64_round(0, ctx->v[j])) * XXH_P1 + XXH_P4;
+	}
+	else
+		h = XXH_P5;
+	
+	h += ctx->total;
+	
+	for (i = 0; i + 8 <= ctx->len; i += 8) 
+	{
+		uint64_t k;
+		
+		memcpy(&k, ctx->buff + i, 8);
+		h ^= xxh64_round(0, k);
+		h = ((h << 27) | (h >> 37)) * XXH_P1 + XXH_P4;
+	}
+	
+	if (i + 4 <= ctx->len)
+	{
+		uint32_t k;
+		
+		memcpy(&k, ctx->buff + i, 4);
+		h ^= k * XXH_P1;
+		h = ((h << 23) | (h >> 41)) * XXH_P2 + XXH_P3;
+		i += 4;
+	}
+	
+	for (; i < ctx->len; ++i) 
+	{
+		h ^= ctx->buff[i] * XXH_P5;
+		h = ((h << 11) | (h >> 53)) * XXH_P1;
+	}
+	
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+	
+	return h;
+}
+
+void sha256_init(SHA256_CTX * ctx)
+{
+	// the initial hash values of FIPS 180-4
+	static const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+	
+	memcpy(ctx->st, init, sizeof(init));
+	ctx->len = 0;
+	ctx->total = 0;
+}
+
+void sha256_update(SHA256_CTX * ctx, const byte * data, size_t len)
+{
+	// goes through 64 byte blocks, a part of one waits in ctx->buff
+	size_t n;
+	
+	ctx->total += len;
+	
+	if (ctx->len > 0)
+	{
+		n = (len < 64 - ctx->len) ? len : 64 - ctx->len;
+		
+		memcpy(ctx->buff + ctx->len, data, n);
+		ctx->len += n;
+		data += n;
+		len -= n;
+		
+		if (ctx->len < 64)
+			return;
+		
+		sha256_blocks(ctx->st, ctx->buff, 1);
+		ctx->len = 0;
+	}
+	
+	n = len / 64;
+	if (n > 0)
+		sha256_blocks(ctx->st, data, n);
+	
+	memcpy(ctx->buff, data + n * 64, len % 64);
+	ctx->len = len % 64;
+}
+
+void sha256_final(SHA256_CTX * ctx, byte * digest)
+{
+	// pads the last block with the length in bits and writes the 32 byte digest
+	uint64_t bits = ctx->total * 8;
+	int i;
+	
+	ctx->buff[ctx->len++] = 0x80;
+	if (ctx->len > 56)
+	{
+		memset(ctx->buff + ctx->len, 0, 64 - ctx->len);
+		sha256_blocks(ctx->st, ctx->buff, 1);
+		ctx->len = 0;
+	}
+	
+	memset(ctx->buff + ctx->len, 0, 56 - ctx->len);
+	for (i = 0; i < 8; ++i) 
+		ctx->buff[56 + i] = (byte)(bits >> (56 - i * 8));
+	sha256_blocks(ctx->st, ctx->buff, 1);
+	
+	for (i = 0; i < 32; ++i) 
+		digest[i] = (byte)(ctx->st[i / 4] >> (24 - (i % 4) * 8));
+}
+
+void sha256_blocks(uint32_t * st, const byte * data, size_t blocks)
+{
+	// runs the compression function over blocks of 64 bytes
+	size_t blk;
+	int i;
+	
+#ifdef X86_SIMD
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+	{
+		sha256_blocks_shani(st, data, blocks);
+		return;
+	}
+#endif
+	
+	for (blk = 0; blk < blocks; ++blk, data += 64) 
+	{
+		uint32_t w[64], s[8];
+		
+		for (i = 0; i < 16; ++i) 
+			w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 | (uint32_t)data[i * 4 + 2] << 8 | data[i * 4 + 3];
+		
+		for (i = 16; i < 64; ++i) 
+			w[i] = w[i - 16] + SHA_S0(w[i - 15]) + w[i - 7] + SHA_S1(w[i - 2]);
+		
+		memcpy(s, st, sizeof(s));
+		
+		for (i = 0; i < 64; ++i) 
+		{
+			uint32_t t1 = s[7] + SHA_E1(s[4]) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + SHA_K[i] + w[i];
+			uint32_t t2 = SHA_E0(s[0]) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+			
+			memmove(s + 1, s, 7 * sizeof(uint32_t));
+			s[4] += t1;
+			s[0] = t1 + t2;
+		}
+		
+		for (i = 0; i < 8; ++i) 
+			st[i] += s[i];
+	}
+}
+
+#ifdef X86_SIMD
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32_pclmul(const byte * data, size_t len, uint32_t crc)
+{
+	/* folds len bytes, a multiple of 16 and at least 64, into the inverted
+	 * crc with carry-less multiplication, then reduces the 128 bits left
+	 * with Barrett's method; the constants are the bit reflected ones of
+	 * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ" */
+	
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5;
+	
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 16));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 32));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 48));
+	data += 64;
+	len -= 64;
+	
+	// four lanes of 16 bytes are folded 64 bytes forward
+	for (; len >= 64; data += 64, len -= 64) 
+	{
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00), _mm_clmulepi64_si128(x1, k1k2, 0x11)),
+		_mm_loadu_si128((const __m128i *)data));
+		x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00), _mm_clmulepi64_si128(x2, k1k2, 0x11)),
+		_mm_loadu_si128((const __m128i *)(data + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00), _mm_clmulepi64_si128(x3, k1k2, 0x11)),
+		_mm_loadu_si128((const __m128i *)(data + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00), _mm_clmulepi64_si128(x4, k1k2, 0x11)),
+		_mm_loadu_si128((const __m128i *)(data + 48)));
+	}
+	
+	// then into one lane, which takes the rest 16 bytes at a time
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x2);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x3);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)), x4);
+	
+	for (; len >= 16; data += 16, len -= 16) 
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), _mm_clmulepi64_si128(x1, k3k4, 0x11)),
+		_mm_loadu_si128((const __m128i *)data));
+	
+	// 128 bits to 64
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00), x2);
+	
+	// Barrett reduction to 32
+	x5 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+	x5 = _mm_clmulepi64_si128(_mm_and_si128(x5, mask), poly, 0x00);
+	x1 = _mm_xor_si128(x1, x5);
+	
+	return _mm_extract_epi32(x1, 1);
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(const byte * data, size_t len, uint32_t crc)
+{
+	// crc32c_update() 8 bytes per crc32 instruction, on the inverted crc
+	uint64_t c = crc;
+	size_t i;
+	
+	for (i = 0; i + 8 <= len; i += 8) 
+	{
+		uint64_t w;
+		
+		memcpy(&w, data + i, 8);
+		c = _mm_crc32_u64(c, w);
+	}
+	
+	for (; i < len; ++i) 
+		c = _mm_crc32_u8((uint32_t)c, data[i]);
+	
+	return (uint32_t)c;
+}
+
+__attribute__((target("sha,sse4.1")))
+void sha256_blocks_shani(uint32_t * st, const byte * data, size_t blocks)
+{
+	/* sha256_blocks() with the sha extensions, two rounds per sha256rnds2
+	 * the state is kept as ABEF and CDGH, the message schedule of four words
+	 * at a time comes from sha256msg1 and sha256msg2 */
+	
+	const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+	__m128i abef, cdgh, tmp, msg[4];
+	size_t blk;
+	int i;
+	
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)st), 0xB1);		// CDAB
+	cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)(st + 4)), 0x1B);	// EFGH
+	abef = _mm_alignr_epi8(tmp, cdgh, 8);
+	cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+	
+	for (blk = 0; blk < blocks; ++blk, data += 64) 
+	{
+		__m128i abef_save = abef, cdgh_save = cdgh;
+		
+		for (i = 0; i < 16; ++i) 
+		{
+			__m128i w;
+			
+			if (i < 4)
+				msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), swap);
+			else
+			{
+				// w[t] = w[t - 16] + s0(w[t - 15]) + w[t - 7] + s1(w[t - 2])
+				tmp = _mm_add_epi32(_mm_sha256msg1_epu32(msg[i % 4], msg[(i + 1) % 4]), 
+				_mm_alignr_epi8(msg[(i + 3) % 4], msg[(i + 2) % 4], 4));
+				msg[i % 4] = _mm_sha256msg2_epu32(tmp, msg[(i + 3) % 4]);
+			}
+			
+			w = _mm_add_epi32(msg[i % 4], _mm_loadu_si128((const __m128i *)(SHA_K + i * 4)));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, w);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(w, 0x0E));
+		}
+		
+		abef = _mm_add_epi32(abef, abef_save);
+		cdgh = _mm_add_epi32(cdgh, cdgh_save);
+	}
+	
+	tmp = _mm_shuffle_epi32(abef, 0x1B);		// FEBA
+	cdgh = _mm_shuffle_epi32(cdgh, 0xB1);		// DCHG
+	_mm_storeu_si128((__m128i *)st, _mm_blend_epi16(tmp, cdgh, 0xF0));			// DCBA
+	_mm_storeu_si128((__m128i *)(st + 4), _mm_alignr_epi8(cdgh, tmp, 8));		// HGFE
+}
+#endif
+
+void serve(const char * path)
+{
+	/* --serve <socket> answers requests on a unix socket, one per line:
+	 * dump <file> <off>:<lines>,...  like -wn, from the file kept open
+	 * search <file> <options>        like thed <file> <options> with -s
+	 * replace <file> <options>       like thed <file> <options> with -r or -re
+	 * info <file>                    like -i
+	 * quit                           closes the connection
+	 * every response ends with a line holding only a dot
+	 * the responses are cached for every file and dropped when it changes */
+	
+	struct sockaddr_un addr;
+	struct stat st;
+	struct pollfd pfd[SRV_CLIENTS + 1];
+	SRV_CLIENT cl[SRV_CLIENTS];
+	SRV_FILE files[SRV_FILES];
+	OUT out;
+	int lfd, i;
+	
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Err: socket path too long.\n");
+		exit(1);
+	}
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	
+	// a socket left by an earlier server is in the way
+	if (0 == lstat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+	
+	if ((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	listen(lfd, SRV_CLIENTS) != 0)
+	{
+		fprintf(stderr, "Err: can't listen on %s.\n", path);
+		exit(1);
+	}
+	
+	// a client which goes away mustn't take the server down with it
+	signal(SIGPIPE, SIG_IGN);
+	
+	// every file is mapped once, for the dumps and the requests, see srv_run()
+	map_force = true;
+	
+	memset(files, 0, sizeof(files));
+	for (i = 0; i < SRV_CLIENTS; ++i) 
+		cl[i].fd = -1;
+	
+	// the responses are built in the buffer, it's never flushed
+	out_open(&out, -1);
+	
+	fprintf(stderr, "Serving on %s.\n", path);
+	
+	while (true)
+	{
+		int n = 0;
+		
+		pfd[n].fd = lfd;
+		pfd[n++].events = POLLIN;
+		for (i = 0; i < SRV_CLIENTS; ++i) 
+		{
+			pfd[n].fd = cl[i].fd;
+			pfd[n++].events = POLLIN;
+		}
+		
+		if (poll(pfd, n, -1) < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			
+			fprintf(stderr, "Err: poll failed.\n");
+			exit(1);
+		}
+		
+		if (pfd[0].revents & POLLIN)
+		{
+			int fd = accept(lfd, NULL, NULL);
+			
+			for (i = 0; fd >= 0 && i < SRV_CLIENTS && cl[i].fd >= 0; ++i) 
+				continue;
+			
+			if (fd >= 0 && SRV_CLIENTS == i)
+				close(fd);
+			else if (fd >= 0)
+			{
+				cl[i].fd = fd;
+				cl[i].len = 0;
+				if ( !(cl[i].buff = (char *)malloc(SRV_LINE)) )
+				{
+					fprintf(stderr, "Err: unable to allocate request buffer.\n");
+					exit(1);
+				}
+			}
+		}
+		
+		for (i = 0; i < SRV_CLIENTS; ++i) 
+		{
+			if (cl[i].fd >= 0 && (pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) && !srv_read(&cl[i], files, &out))
+			{
+				close(cl[i].fd);
+				free(cl[i].buff);
+				cl[i].fd = -1;
+			}
+		}
+	}
+}
+
+bool srv_read(SRV_CLIENT * cl, SRV_FILE * files, OUT * out)
+{
+	// reads from a client and answers every whole request line, false closes it
+	
+	char * nl;
+	ssize_t n = read(cl->fd, cl->buff + cl->len, SRV_LINE - cl->len);
+	
+	if (n < 0 && EINTR == errno)
+		return true;
+	
+	if (n <= 0)
+		return false;
+	
+	cl->len += n;
+	
+	while ( (nl = memchr(cl->buff, '\n', cl->len)) )
+	{
+		size_t len = nl - cl->buff + 1;
+		
+		*nl = '\0';
+		if (nl > cl->buff && '\r' == nl[-1])
+			nl[-1] = '\0';
+		
+		if (!srv_request(cl->fd, cl->buff, files, out))
+			return false;
+		
+		memmove(cl->buff, cl->buff + len, cl->len - len);
+		cl->len -= len;
+	}
+	
+	// a line which doesn't fit isn't a request
+	if (SRV_LINE == cl->len)
+	{
+		const char * err = "Err: request too long.\n";
+		srv_reply(cl->fd, err, strlen(err));
+		return false;
+	}
+	
+	return true;
+}
+
+bool srv_request(int fd, const char * line, SRV_FILE * files, OUT * out)
+{
+	/* answers one request line, from the cache if it's there
+	 * returns false if the client asked to quit or can't be written to */
+	
+	char req[SRV_LINE];
+	char * argv[SRV_ARGS];
+	char err[256];
+	SRV_FILE * f;
+	SRV_ENTRY * e;
+	int argc;
+	
+	strcpy(req, line);
+	argc = srv_split(req, argv);
+	
+	if (0 == argc)
+		return true;
+	
+	if (0 == strcmp(argv[0], "quit"))
+		return false;
+	
+	if (argc < 2 || (strcmp(argv[0], "dump") && strcmp(argv[0], "search") && strcmp(argv[0], "replace") &&
+	strcmp(argv[0], "info")))
+	{
+		snprintf(err, sizeof(err), "Err: bad request, use dump, search, replace, info or quit.\n");
+		return srv_reply(fd, err, strlen(err));
+	}
+	
+	if ( !(f = srv_file(files, argv[1], err, sizeof(err))) )
+		return srv_reply(fd, err, strlen(err));
+	
+	if ( (e = srv_cached(f, line)) )
+		return srv_reply(fd, e->resp, e->len);
+	
+	if (0 == strcmp(argv[0], "dump"))
+	{
+		if (3 != argc || !srv_dump(f, argv[2], out, err, sizeof(err)))
+		{
+			if (3 != argc)
+				snprintf(err, sizeof(err), "Err: use dump <file> <offset>:<lines>,...\n");
+			return srv_reply(fd, err, strlen(err));
+		}
+		
+		srv_cache(f, line, out->buff, out->len);
+		return srv_reply(fd, out->buff, out->len);
+	}
+	else if (0 == strcmp(argv[0], "info"))
+	{
+		// the size is known from when the file was opened
+		if (2 != argc)
+		{
+			snprintf(err, sizeof(err), "Err: bad info request.\n");
+			return srv_reply(fd, err, strlen(err));
+		}
+		
+		out->len = 0;
+		file_info(out, f->st.st_size);
+		return srv_reply(fd, out->buff, out->len);
+	}
+	else
+	{
+		size_t len;
+		bool ok, is_write = (0 == strcmp(argv[0], "replace"));
+		char * resp = srv_run(f, argc, argv, &len, &ok);
+		
+		// the file changed under the cache and the open file
+		if (is_write)
+			srv_drop(f);
+		else if (ok)
+			srv_cache(f, line, resp, len);
+		
+		ok = srv_reply(fd, resp, len);
+		free(resp);
+		return ok;
+	}
+}
+
+int srv_split(char * line, char ** argv)
+{
+	/* splits line in place into at most SRV_ARGS - 1 words, a word in
+	 * double quotes can have spaces; returns the number of words */
+	
+	int argc = 0;
+	
+	while (*line && argc < SRV_ARGS - 1)
+	{
+		while (' ' == *line || '\t' == *line)
+			++line;
+		
+		if ('\0' == *line)
+			break;
+		
+		if ('"' == *line)
+		{
+			argv[argc++] = ++line;
+			while (*line && '"' != *line)
+				++line;
+		}
+		else
+		{
+			argv[argc++] = line;
+			while (*line && ' ' != *line && '\t' != *line)
+				++line;
+		}
+		
+		if (*line)
+			*line++ = '\0';
+	}
+	
+	argv[argc] = NULL;
+	return argc;
+}
+
+SRV_FILE * srv_file(SRV_FILE * files, const char * path, char * err, size_t err_len)
+{
+	/* returns the open file for path, opening it if needed
+	 * a file which changed since it was opened is opened again
+	 * with an empty cache; NULL and a message in err if it can't be opened */
+	
+	struct stat st;
+	SRV_FILE * f = NULL;
+	int i;
+	
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		snprintf(err, err_len, "Err: %s isn't a regular file.\n", path);
+		return NULL;
+	}
+	
+	for (i = 0; i < SRV_FILES; ++i) 
+	{
+		if (files[i].path && 0 == strcmp(files[i].path, path))
+		{
+			f = &files[i];
+			break;
+		}
+	}
+	
+	if (f && (f->st.st_dev != st.st_dev || f->st.st_ino != st.st_ino || f->st.st_size != st.st_size ||
+	f->st.st_mtim.tv_sec != st.st_mtim.tv_sec || f->st.st_mtim.tv_nsec != st.st_mtim.tv_nsec))
+		srv_drop(f);
+	else if (f)
+		return f;
+	
+	// a free slot, or the first one if there's none
+	for (i = 0; i < SRV_FILES && files[i].path; ++i) 
+		continue;
+	
+	f = &files[i % SRV_FILES];
+	srv_drop(f);
+	
+	if ( !(f->path = strdup(path)) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	src_open(&f->src, path);
+	if (f->src.map)
+		madvise((void *)f->src.map, f->src.size, MADV_RANDOM);
+	f->st = st;
+	
+	return f;
+}
+
+void srv_drop(SRV_FILE * f)
+{
+	// closes a file of the server and empties its cache
+	int i;
+	
+	if (!f->path)
+		return;
+	
+	for (i = 0; i < SRV_CACHE; ++i) 
+	{
+		free(f->cache[i].req);
+		free(f->cache[i].resp);
+	}
+	
+	src_close(&f->src);
+	free(f->path);
+	memset(f, 0, sizeof(SRV_FILE));
+}
+
+SRV_ENTRY * srv_cached(SRV_FILE * f, const char * req)
+{
+	// returns the cached response to req, or NULL
+	int i;
+	
+	for (i = 0; i < SRV_CACHE; ++i) 
+	{
+		if (f->cache[i].req && 0 == strcmp(f->cache[i].req, req))
+			return &f->cache[i];
+	}
+	
+	return NULL;
+}
+
+void srv_cache(SRV_FILE * f, const char * req, const char * resp, size_t len)
+{
+	// keeps a response in the cache of f in place of the oldest one
+	SRV_ENTRY * e = &f->cache[f->next];
+	
+	if (len > SRV_CACHE_MAX)
+		return;
+	
+	free(e->req);
+	free(e->resp);
+	
+	if ( !(e->req = strdup(req)) || !(e->resp = (char *)malloc(len + 1)) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	
+	memcpy(e->resp, resp, len);
+	e->len = len;
+	f->next = (f->next + 1) % SRV_CACHE;
+}
+
+bool srv_dump(SRV_FILE * f, const char * list, OUT * out, char * err, size_t err_len)
+{
+	/* dumps the windows of list into out like -wn
+	 * the whole response has to fit in the buffer, so it's never flushed
+	 * returns false and a message in err if a window is bad */
+	
+	const char * p = list;
+	off_t start;
+	long long lines, total = 0;
+	
+	// check them all first
+	while (*p)
+	{
+		const char * win = p; // p is past it once it's parsed
+		
+		if (!window_parse(&p, &start, &lines) || 0 > start)
+		{
+			snprintf(err, err_len, "Err: bad window %.*s.\n", (int)strcspn(win, ","), win);
+			return false;
+		}
+		
+		// every window can end with a line of end marks
+		total += lines + 1;
+		if (total > OUT_SIZE / HEX_LN_LEN)
+		{
+			snprintf(err, err_len, "Err: windows are over %d lines.\n", OUT_SIZE / HEX_LN_LEN - 1);
+			return false;
+		}
+	}
+	
+	out->len = 0;
+	for (p = list; *p; ) 
+	{
+		window_parse(&p, &start, &lines);
+		hex_window(out, &f->src, start, lines, f->st.st_size);
+	}
+	
+	return true;
+}
+
+char * srv_run(SRV_FILE * f, int argc, char ** argv, size_t * len, bool * ok)
+{
+	/* runs a search or replace request on f in a child process, so
+	 * thed's own code prints the response and an error only ends the child
+	 * the child reads f through the mapping the server already has
+	 * returns the output of the child, and in *ok if it succeeded */
+	
+	int pfd[2], status = -1;
+	char * resp = NULL;
+	size_t cap = 0;
+	pid_t pid = -1;
+	
+	*len = 0;
+	*ok = false;
+	fflush(stdout);
+	fflush(stderr);
+	
+	if (0 == pipe(pfd) && (pid = fork()) < 0)
+	{
+		close(pfd[0]);
+		close(pfd[1]);
+	}
+	
+	if (pid < 0)
+	{
+		// only this request fails, the server goes on
+		const char * err = "Err: unable to start a request.\n";
+		
+		if ( !(resp = strdup(err)) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+		
+		*len = strlen(err);
+		return resp;
+	}
+	
+	if (0 == pid)
+	{
+		char * cmd = argv[0];
+		int opt;
+		
+		dup2(pfd[1], STDOUT_FILENO);
+		dup2(pfd[1], STDERR_FILENO);
+		close(pfd[0]);
+		close(pfd[1]);
+		
+		srv_kept = f;
+		
+		// thed <file> <options>, the command stands in for the program name
+		opt = check_args(argc, argv);
+		
+		if ((0 == strcmp(cmd, "search") && !(OPT_SRCH == opt && !replace_everything)) ||
+		(0 == strcmp(cmd, "replace") && !(OPT_REPLACE == opt || (OPT_SRCH == opt && replace_everything))))
+		{
+			fprintf(stderr, "Err: bad %s request.\n", cmd);
+			exit(1);
+		}
+		
+		edit_open(opt);
+		run_opt(opt, argc, argv);
+		exit(0);
+	}
+	
+	close(pfd[1]);
+	
+	while (true)
+	{
+		ssize_t n;
+		
+		if (*len == cap && !(resp = (char *)realloc(resp, (cap = cap ? cap * 2 : BLK_SIZE))) )
+		{
+			fprintf(stderr, "Err: unable to allocate response buffer.\n");
+			exit(1);
+		}
+		
+		n = read(pfd[0], resp + *len, cap - *len);
+		if (n < 0 && EINTR == errno)
+			continue;
+		if (n <= 0)
+			break;
+		*len += n;
+	}
+	
+	close(pfd[0]);
+	while (waitpid(pid, &status, 0) < 0 && EINTR == errno)
+		continue;
+	
+	*ok = WIFEXITED(status) && 0 == WEXITSTATUS(status);
+	return resp;
+}
+
+bool srv_reply(int fd, const char * resp, size_t len)
+{
+	// sends a response and the line which ends it, false if the client is gone
+	size_t done = 0;
+	
+	while (done < len + SRV_END_LEN)
+	{
+		ssize_t n = (done < len) ? send(fd, resp + done, len - done, MSG_NOSIGNAL) :
+		send(fd, SRV_END + done - len, len + SRV_END_LEN - done, MSG_NOSIGNAL);
+		
+		if (n < 0 && EINTR == errno)
+			continue;
+		
+		if (n <= 0)
+			return false;
+		done += n;
+	}
+	
+	return true;
+}
+
+void print_stats(const char * fname, long long blk)
+{
+	/* -E prints the byte histogram and the entropy of the bytes a dump
+	 * with the same -o and -l would show, then the entropy of every blk
+	 * bytes of them, in plain columns for plotting
+	 * with -j the blocks of a regular file are split between threads */
 	
-	/* the value in unicode_mode is used to calculate if we need to
-	 * skip every second byte in the buffer when comparing the strings */
-	int unicode_mode = (UNICODE == mode) ? 1 : 0;
-	int srch_str_len = strlen(sequence);
-	int srch_seq_len = srch_str_len * (unicode_mode + 1);
-	unsigned int matches_found = 0;
-	unsigned int matches_replaced = 0;
+	SRC src;
+	OUT out;
+	uint64_t hist[256] = {0};
+	double * xlogx;
+	double * ent = NULL;
+	off_t file_end, len, blocks = 0, i;
+	double total = 0.0;
+	int b;
 	
-	// open for binary read
-	fp = open_file(fname, "rb");
+	src_open(&src, fname);
+	file_end = dump_range(&src, &len);
 	
-	if (BIN == mode)
+	if (blk < MAX || blk > BLK_SIZE)
 	{
-		byte_buff = hexstr_to_bytes(sequence, &buff_len);
-		srch_seq_len = buff_len;
-		srch_str_len = buff_len;
-		sequence = (char *)byte_buff;
+		fprintf(stderr, "Err: the block size must be between %d and %d.\n", MAX, BLK_SIZE);
+		exit(1);
 	}
 	
-	// create char buffer
-	char buff[srch_seq_len];
+	// c * log2(c) for every count a block can have
+	if ( !(xlogx = (double *)malloc((blk + 1) * sizeof(double))) )
+	{
+		fprintf(stderr, "Err: memory allocation failed.\n");
+		exit(1);
+	}
+	xlogx[0] = 0.0;
+	for (i = 1; i <= blk; ++i) 
+		xlogx[i] = i * log2((double)i);
 	
-	// read bytes one by one until the first one matches
-	while ( (n = fread(&ch, sizeof(char), 1, fp)) > 0 )
+	if (jobs > 1 && file_end >= 0 && len >= HASH_PAR_MIN)
+		ent = stat_parallel(&src, offset, len, blk, xlogx, hist, &blocks);
+	else
 	{
-		if (ch == sequence[0])
+		const byte * data, * tail = NULL;
+		size_t n, carry = 0, k;
+		off_t done = 0, cap = 0;
+		
+		// a block can start in one read and end in the next one
+		src_seek(&src, offset);
+		while (len < 0 || done < len)
 		{
-			// get match offset
-			long saved_match_pos;
-			fseek(fp, -1L, SEEK_CUR); 	// decrement one place because of n above
-			saved_match_pos = ftell(fp);// that's the start of our match
-			
-			// read a string as long as the search sequence
-			// NOTE: no '\0' character is read
-			if (fread(buff, sizeof(char), srch_seq_len, fp) != srch_seq_len)
+			// at the end data points to the kept bytes
+			if (0 == (n = src_next(&src, carry, &data)))
 			{
-				if (feof(fp))
-					goto matches_and_go;
-				else
-					fprintf(stderr, "Err: read error.\n");
+				tail = data;
+				break;
 			}
 			
-			// compare the strings
-			int i, j;
-			bool is_match = true;
-			for (i = 0, j = 0; i < srch_str_len; ++i, j += 1 + unicode_mode)
-			{
-				if (buff[j] != sequence[i])
-				{
-					is_match = false;
-					break;
-				}
-			}
+			if (len >= 0 && (off_t)(n - carry) > len - done)
+				n = carry + (len - done);
+			done += n - carry;
 			
-			// print match offset
-			if (is_match)
+			if (blocks + (off_t)(n / blk) + 1 > cap)
 			{
-				fprintf(stdout, "Match found at: %#lx\n", saved_match_pos);
-				++matches_found;
-				is_match = false;
-				
-				// if -re go ahead and replace what is found
-				if (replace_everything)
+				cap = (blocks + n / blk + 1) * 2;
+				if ( !(ent = (double *)realloc(ent, cap * sizeof(double))) )
 				{
-					offset = saved_match_pos;
-					replace(mode, fname, replace_only_seq);
-					fprintf(stdout, "Match replaced.\n");
-					++matches_replaced;
+					fprintf(stderr, "Err: memory allocation failed.\n");
+					exit(1);
 				}
 			}
-			/* set file pointer just one byte after the match of the first byte 
-			 * so we won't skip recurring patterns */
-			fseek(fp, saved_match_pos + 1L, SEEK_SET);
+			
+			for (k = 0; k + blk <= n; k += blk) 
+				ent[blocks++] = stat_block(data + k, blk, hist, xlogx);
+			
+			carry = n - k;
+			tail = data + k;
 		}
+		
+		if (carry > 0)
+			ent[blocks++] = stat_block(tail, carry, hist, xlogx);
+		len = done;
 	}
 	
-	if (ferror(fp))
-	{
-		fprintf(stderr, "Err: read error.\n");
-		exit(1);
-	}
+	out_open(&out, STDOUT_FILENO);
 	
-	matches_and_go:
-		// print number of matches found
-		fprintf(stdout, "%u %s found.\n", matches_found, (matches_found != 1) ? "matches" : "match");
-		
-		if (replace_everything) // print number of replaced matches
-			fprintf(stdout, "%u %s replaced.\n", matches_replaced, (matches_replaced != 1) ? "matches" : "match");
+	for (b = 0; b < 256; ++b) 
+		total += (hist[b] > 0) ? hist[b] * log2((double)hist[b]) : 0.0;
 	
-	if (BIN == mode)
-		free((void *)sequence);
-			
-	fclose(fp);
+	out_printf(&out, "%-8s %#llx - %#llx, %lld bytes\n", "Range:", (unsigned long long)offset, 
+	(unsigned long long)(offset + len - (len > 0)), (long long)len);
+	out_printf(&out, "%-8s %.4f bits per byte\n", "Entropy:", (len > 0) ? log2((double)len) - total / len : 0.0);
+	
+	out_printf(&out, "\nByte Count Percent\n");
+	for (b = 0; b < 256; ++b) 
+		out_printf(&out, "%02X %llu %.4f\n", b, (unsigned long long)hist[b], (len > 0) ? hist[b] * 100.0 / len : 0.0);
+	
+	out_printf(&out, "\nOffset Entropy of %lld byte blocks\n", blk);
+	for (i = 0; i < blocks; ++i) 
+		out_printf(&out, "%#llx %.4f\n", (unsigned long long)(offset + i * blk), ent[i]);
+	
+	out_close(&out);
+	free(ent);
+	free(xlogx);
+	src_close(&src);
 }
 
-void replace(const char mode, const char * fname, const char * sequence)
+double * stat_parallel(SRC * src, off_t start, off_t len, long long blk, const double * xlogx, uint64_t * hist, off_t * blocks)
 {
-	// writes a sequence starting from an offset in the file
+	// splits the blocks between the threads, each one counts its own histogram
+	STAT_JOB job_arr[MAX_JOBS];
+	off_t part;
+	double * ent;
+	int n, i, b;
 	
-	// check replace mode
-	// in case of -re it's the same as the search mode
-	if (BIN != mode && ASCII != mode && UNICODE != mode)
+	*blocks = (len + blk - 1) / blk;
+	part = (*blocks + jobs - 1) / jobs;
+	
+	if ( !(ent = (double *)malloc(*blocks * sizeof(double))) )
 	{
-		fprintf(stderr, "Err: invalid replace mode.\n");
+		fprintf(stderr, "Err: memory allocation failed.\n");
 		exit(1);
 	}
 	
-	FILE * fp;
-	int buff_len = 0;
+	for (n = 0; n < jobs && n * part < *blocks; ++n) 
+	{
+		job_arr[n].src = src;
+		job_arr[n].start = start + n * part * blk;
+		job_arr[n].len = (len - n * part * blk < part * blk) ? len - n * part * blk : part * blk;
+		job_arr[n].blk = blk;
+		job_arr[n].xlogx = xlogx;
+		job_arr[n].ent = ent + n * part;
+		memset(job_arr[n].hist, 0, sizeof(job_arr[n].hist));
+	}
 	
-	if (BIN == mode)	// convert a string of hex number to binary values
-		sequence = (char *)hexstr_to_bytes(sequence, &buff_len);
-		
-	if (ASCII == mode)
-		buff_len = strlen(sequence);
-		
-	if (UNICODE == mode) // convert an ASCII string to Unicode
-		sequence = astr_to_ucstr(sequence, &buff_len);
-		
-	// binary read/write allows random access
-	fp = open_file(fname, "rb+");
-	fseek(fp, offset, SEEK_SET);
+	run_jobs(stat_job, job_arr, sizeof(STAT_JOB), n);
+	
+	for (i = 0; i < n; ++i) 
+		for (b = 0; b < 256; ++b) 
+			hist[b] += job_arr[i].hist[b];
+	
+	return ent;
+}
+
+void * stat_job(void * arg)
+{
+	// the blocks of one job, from the map or read with pread() a few at a time
+	STAT_JOB * job = (STAT_JOB *)arg;
+	off_t done, step = BLK_SIZE / job->blk * job->blk;
+	byte * buff = NULL;
+	double * ent = job->ent;
 	
-	if (fwrite(sequence, sizeof(char), buff_len, fp) < buff_len )
+	if (!job->src->map && !(buff = (byte *)malloc(step)))
 	{
-		fprintf(stderr, "Err: write error.\n");
-		fclose(fp);
+		fprintf(stderr, "Err: memory allocation failed.\n");
 		exit(1);
 	}
+	
+	for (done = 0; done < job->len; done += step) 
+	{
+		size_t n = (job->len - done < step) ? job->len - done : step, k;
+		const byte * data = buff;
 		
-	if (!replace_everything) // in case of a single replace
-		fprintf(stdout, "Replace successful.\n");
-		
-	if (BIN == mode)
-		free((void *)sequence);
-		
-	if (UNICODE == mode)
-		free((void *)sequence);
+		if (job->src->map)
+			data = job->src->map + job->start + done;
+		else if (src_pread(job->src, buff, n, job->start + done) != n)
+		{
+			fprintf(stderr, "Err: read error.\n");
+			exit(1);
+		}
 		
-	fclose(fp);
+		for (k = 0; k < n; k += job->blk) 
+			*ent++ = stat_block(data + k, (n - k < (size_t)job->blk) ? n - k : job->blk, job->hist, job->xlogx);
+	}
+	
+	free(buff);
+	return NULL;
 }
 
-char * astr_to_ucstr(const char * str, int * out_buff_size)
+double stat_block(const byte * data, size_t len, uint64_t * hist, const double * xlogx)
 {
-	/* converts an ASCII string to Unicode by inserting 
-	 * 00 bytes inbetween characters 
-	 * works for characters from the ASCII table only 
-	 * returns a pointer to the string buffer, and writes down
-	 * the buffer size at &out_buff_size */
+	/* returns the entropy of len bytes in bits per byte and adds them to hist
+	 * the bytes are counted in 4 tables, a byte to each in turn, so a run
+	 * of one value doesn't wait on the same counter over and over */
 	
-	int i, j;
-	char * char_buff;
-	int str_len = strlen(str);
+	uint32_t count[4][256];
+	double sum = 0.0;
+	size_t i;
+	int b;
 	
-	// allocate buffer
-	if (!(char_buff = (char *)malloc(str_len * 2)) )
+	memset(count, 0, sizeof(count));
+	
+	for (i = 0; i + 8 <= len; i += 8) 
 	{
-		fprintf(stderr, "Err: unable to allocate character buffer.\n");
-		exit(1);
+		uint64_t w;
+		
+		memcpy(&w, data + i, 8);
+		++count[0][w & 0xFF];
+		++count[1][(w >> 8) & 0xFF];
+		++count[2][(w >> 16) & 0xFF];
+		++count[3][(w >> 24) & 0xFF];
+		++count[0][(w >> 32) & 0xFF];
+		++count[1][(w >> 40) & 0xFF];
+		++count[2][(w >> 48) & 0xFF];
+		++count[3][w >> 56];
 	}
 	
-	// make every second byte 0
-	for (i = 0, j = 0; i < str_len; ++i) 
+	for (; i < len; ++i) 
+		++count[0][data[i]];
+	
+	for (b = 0; b < 256; ++b) 
 	{
-		char_buff[j++] = str[i];
-		char_buff[j++] = 0;
+		uint32_t c = count[0][b] + count[1][b] + count[2][b] + count[3][b];
+		
+		hist[b] += c;
+		sum += xlogx[c];
 	}
 	
-	*out_buff_size = j; // save buffer size
-	return char_buff;
+	return log2((double)len) - sum / len;
 }
 
-byte * hexstr_to_bytes(const char * str, int * out_buff_size)
+static inline bool str_is_print(byte b)
 {
-	/* converts a hex ASCII string to binary values
-	 * returns a pointer to the buffer with the values
-	 * and writes down the buffer size at &out_buff_size */
+	// a byte the char column shows as it is, ASCII only
+	return b >= 0x20 && b < 0x7F;
+}
+
+void print_strings(const char * fname, long long min_len)
+{
+	/* -S prints every run of at least min_len ASCII or UTF-16LE characters
+	 * with its offset, the characters are the ones the char column of a dump
+	 * shows as they are, without the ones above 0x7F
+	 * with -j a mapped file is split in STR_SEG segments, a run belongs to
+	 * the segment it starts in and is read past its end if it goes on */
 	
-	int i, j, k;
-	char str_hex[strlen(str)];
-	char ch;
-	byte * byte_buff;
+	SRC src;
+	OUT out;
+	STR_JOB job_arr[MAX_JOBS];
+	off_t file_end, len;
+	int i;
 	
-	for (i = 0, j = 0; '\0' != str[i]; ++i) 
+	if (min_len < 1)
 	{
-		
-		ch = toupper(str[i]);
-		
-		// get only hex characters	
-		if (('0' <= ch && '9' >= ch) || ('A' <= ch && 'F' >= ch))
-			str_hex[j++] = ch;
+		fprintf(stderr, "Err: the minimum string length must be at least 1.\n");
+		exit(1);
 	}
 	
-	if (j % 2)
+	// segments need the whole file at hand
+	if (jobs > 1)
+		map_force = true;
+	
+	src_open(&src, fname);
+	file_end = dump_range(&src, &len);
+	out_open(&out, STDOUT_FILENO);
+	
+	for (i = 0; i < jobs; ++i) 
 	{
-		fprintf(stderr, "Err: odd number of hex digits.\n");
-		exit(1);
+		memset(&job_arr[i], 0, sizeof(STR_JOB));
+		job_arr[i].min_len = min_len;
 	}
 	
-	str_hex[j] = '\0';
-	
-	// allocate buffer
-	if (!(byte_buff = (byte *)malloc(j)) )
+	if (jobs > 1 && file_end >= 0 && src.map)
 	{
-		fprintf(stderr, "Err: unable to allocate byte buffer.\n");
-		exit(1);
+		const byte * data = src.map + offset;
+		off_t start;
+		int n;
+		
+		for (start = 0; start < len; ) 
+		{
+			for (n = 0; n < jobs && start < len; ++n, start += STR_SEG) 
+			{
+				job_arr[n].data = data;
+				job_arr[n].len = len;
+				job_arr[n].lo = start;
+				job_arr[n].hi = (len - start > STR_SEG) ? start + STR_SEG : len;
+			}
+			
+			run_jobs(str_job, job_arr, sizeof(STR_JOB), n);
+			
+			for (i = 0; i < n; ++i) 
+				str_print(&out, &job_arr[i], offset, job_arr[i].hi);
+		}
+	}
+	else
+	{
+		/* a run which reaches the end of a block is scanned again with the next
+		 * one, with up to 2 bytes before it to tell if it goes on from there */
+		STR_JOB * job = &job_arr[0];
+		const byte * data;
+		size_t n, carry = 0, ctx = 0, cut;
+		off_t done = 0;
+		bool at_end = false;
+		
+		src_seek(&src, offset);
+		while (!at_end)
+		{
+			if (0 == (n = src_next(&src, carry, &data)))
+			{
+				// data points to the kept bytes
+				n = carry;
+				at_end = true;
+			}
+			
+			if (len >= 0 && done + (off_t)(n - carry) >= len)
+			{
+				n = carry + (len - done);
+				at_end = true;
+			}
+			done += n - carry;
+			
+			job->data = data;
+			job->len = n;
+			job->lo = ctx;
+			job->hi = n;
+			job->at_end = at_end;
+			
+			cut = str_scan(job);
+			str_print(&out, job, offset + done - n, cut);
+			ctx = (cut < 2) ? cut : 2;
+			carry = n - cut + ctx;
+		}
 	}
 	
-	// convert hex characters to binary values
-	for (i = 0, k = 0; i < j; i += 2, ++k) 
-		hex_chars_to_byte(&str_hex[i], &byte_buff[k]);
-
-	*out_buff_size = k; // save buffer size
-
-	return byte_buff;
+	out_close(&out);
+	
+	for (i = 0; i < jobs; ++i) 
+	{
+		free(job_arr[i].ascii.runs);
+		free(job_arr[i].wide.runs);
+	}
+	src_close(&src);
 }
 
-void print_conv_nums(const char * str, int from_base, int to_base)
+void * str_job(void * arg)
 {
-	// number conversion output
+	// one segment of print_strings(), the map goes on after it
+	STR_JOB * job = (STR_JOB *)arg;
 	
-	unsigned long long number;
-	int i, j, k, l;
+	job->at_end = true;
+	str_scan(job);
+	return NULL;
+}
+
+size_t str_scan(STR_JOB * job)
+{
+	/* finds the runs which start between job->lo and job->hi
+	 * a run going on from before lo is someone else's, a run reaching
+	 * the end of the data is cut unless job->at_end, then the smallest
+	 * start of such a run is returned so it can be scanned again with more
+	 * data, and the runs from there on shouldn't be printed; else hi */
 	
-	i = strlen(str);
-	char clean_str[i + 1];
+	const byte * data = job->data;
+	size_t len = job->len, p, q, to, cut = job->hi, cut_wide = job->hi;
 	
-	// prepare a clean string for strtoull()
+	job->ascii.count = 0;
+	job->wide.count = 0;
 	
-	if ('0' == str[0] && 'X' == toupper(str[1])) // skip 0x
-		str += 2;
+	for (p = job->lo; (p = str_find(data, p, job->hi, STR_PRINT)) < job->hi; p = q) 
+	{
+		q = str_find(data, p, len, STR_CTRL);
+		
+		if (p == job->lo && p > 0 && str_is_print(data[p - 1]))
+			continue;
+		
+		if (len == q && !job->at_end)
+		{
+			cut = p;
+			break;
+		}
+		
+		if ((long long)(q - p) >= job->min_len)
+			str_add(&job->ascii, p, q - p);
+	}
 	
-	for (i = 0, l = 0, k = from_base - 1; '\0' != str[i]; ++i) 
+	// a UTF-16LE character is a printable byte and a 0 byte
+	to = (len - 1 < job->hi) ? len - 1 : job->hi;
+	for (p = job->lo; len > 0 && (p = str_find(data, p, to, STR_WIDE)) < to; p = q) 
 	{
-		j = toupper(str[i]);
+		for (q = p; q + 1 < len && str_is_print(data[q]) && 0 == data[q + 1]; q += 2) 
+			continue;
 		
-		if (' ' == j) // skip spaces
+		if (p < job->lo + 2 && p >= 2 && str_is_print(data[p - 2]) && 0 == data[p - 1])
 			continue;
 		
-		if ('0' <= j && '9' >= j)
-			j -= '0';
-		else if ('A' <= j && 'F' >= j)
-			j = (j - 'A') + MAGIC;
-			
-		/* check if the value derived from the character is > than 
-		 * the maximum single digit value of the requested base */
-		if (j > k)
+		if (q + 1 >= len && !job->at_end)
 		{
-			fprintf(stderr, "Err: bad number.\n");
-			exit(1);
+			cut_wide = p;
+			break;
 		}
 		
-		clean_str[l++] = str[i];
+		if ((long long)(q - p) / 2 >= job->min_len)
+			str_add(&job->wide, p, (q - p) / 2);
 	}
-	clean_str[l] = '\0'; // end the string
 	
-	number = strtoull(clean_str, NULL, from_base); // convert it to a number
+	// the last byte might start a character
+	if (!job->at_end && cut_wide == job->hi && len > job->lo && str_is_print(data[len - 1]))
+		cut_wide = len - 1;
 	
-	// print original string
-	fprintf(stdout, "%s%s%s= %s", (16 == from_base) ? "0x" : "", str, (2 == from_base) ? "b " : " ",
-	(16 == to_base) ? "0x" : "");
+	return (cut < cut_wide) ? cut : cut_wide;
+}
+
+void str_add(STR_LIST * list, size_t pos, size_t len)
+{
+	// adds a run of len characters at pos
+	if (list->count == list->cap)
+	{
+		list->cap = list->cap ? list->cap * 2 : 1024;
+		if ( !(list->runs = (STR_RUN *)realloc(list->runs, list->cap * sizeof(STR_RUN))) )
+		{
+			fprintf(stderr, "Err: memory allocation failed.\n");
+			exit(1);
+		}
+	}
 	
-	if (0 == number) // special case for binary zero
+	list->runs[list->count].pos = pos;
+	list->runs[list->count++].len = len;
+}
+
+void str_print(OUT * out, const STR_JOB * job, off_t base, size_t cut)
+{
+	// prints the runs of both lists before cut in the order of their offsets
+	size_t a = 0, w = 0, k;
+	
+	while (true)
 	{
-		fprintf(stdout, "%d%c\n", 0, (2 == to_base) ? 'b' : ' ');
-		return;
+		bool is_wide;
+		const STR_RUN * run;
+		char * ln;
+		
+		if (a < job->ascii.count && job->ascii.runs[a].pos < cut && 
+		(w >= job->wide.count || job->ascii.runs[a].pos <= job->wide.runs[w].pos))
+		{
+			run = &job->ascii.runs[a++];
+			is_wide = false;
+		}
+		else if (w < job->wide.count && job->wide.runs[w].pos < cut)
+		{
+			run = &job->wide.runs[w++];
+			is_wide = true;
+		}
+		else
+			break;
+		
+		out_printf(out, "%#llx %c ", (unsigned long long)(base + run->pos), is_wide ? UNICODE : ASCII);
+		
+		// a run longer than the buffer goes out in parts
+		for (k = 0; k < run->len; ) 
+		{
+			size_t n = (run->len - k < OUT_SIZE / 2) ? run->len - k : OUT_SIZE / 2, i;
+			
+			ln = out_reserve(out, n);
+			if (is_wide)
+				for (i = 0; i < n; ++i) 
+					ln[i] = job->data[run->pos + (k + i) * 2];
+			else
+				memcpy(ln, job->data + run->pos + k, n);
+			
+			out->len += n;
+			k += n;
+		}
+		
+		out_write(out, "\n", 1);
 	}
+}
+
+size_t str_find(const byte * data, size_t from, size_t to, int cls)
+{
+	/* returns the first place from from to to where a STR_PRINT byte,
+	 * a STR_CTRL one or a STR_WIDE character starts, to if there's none
+	 * STR_WIDE reads the byte after each one, so to has to be before the end */
 	
-	base_convert(number, to_base); // the actual conversion
+#ifdef X86_SIMD
+	if (__builtin_cpu_supports("avx2"))
+		from = str_find_avx2(data, from, to, cls);
+	else if (__builtin_cpu_supports("sse2"))
+		from = str_find_sse2(data, from, to, cls);
+#endif
 	
-	// print 'b' at the end if the conversion is to binary
-	fprintf(stdout, "%s\n", (2 == to_base) ? "\bb" : "");
+	for (; from < to; ++from) 
+	{
+		bool is_print = str_is_print(data[from]);
+		
+		if ((STR_PRINT == cls && is_print) || (STR_CTRL == cls && !is_print) || 
+		(STR_WIDE == cls && is_print && 0 == data[from + 1]))
+			break;
+	}
 	
-	if (~0ULL == number)
-		fprintf(stdout, "Warning: maximum unsigned long long value is reached.\nMight be overflow.\n");
+	return from;
 }
 
-void base_convert(unsigned long long num, int base)
+#ifdef X86_SIMD
+__attribute__((target("sse2")))
+size_t str_find_sse2(const byte * data, size_t from, size_t to, int cls)
 {
-	/* converts numbers between bases <= 16 
-	 * using lookup tables */
+	/* str_find() 16 bytes at a time, up to the last 16 which are left to it
+	 * a byte is a control one for the char column of hex_chars() if it's
+	 * 0x00 - 0x1F or 0x7F, and not ASCII if it's negative as a signed one */
 	
-	if (0 == num)
-		return;
-	else
-		/* if the base is 2 we still want to divide num by 16
-		 * since it will give us the offset in the binary table */
-		base_convert(num / ((2 != base) ? base : 16), base);
+	for (; from + 16 <= to; from += 16) 
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + from));
+		__m128i ctl = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1F)), v),
+		_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F))), _mm_cmplt_epi8(v, _mm_setzero_si128()));
+		unsigned mask = _mm_movemask_epi8(ctl);
+		
+		if (STR_PRINT == cls)
+			mask = ~mask & 0xFFFF;
+		else if (STR_WIDE == cls)
+			mask = ~mask & _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + from + 1)), 
+			_mm_setzero_si128())) & 0xFFFF;
+		
+		if (mask)
+			return from + __builtin_ctz(mask);
+	}
 	
-	// if the base is 2 look in the binary table
-	(2 == base) ? fprintf(stdout, "%s", BINTBL[num % 16]) : putchar(HEXTBL[num % base]);
+	return from;
+}
+
+__attribute__((target("avx2")))
+size_t str_find_avx2(const byte * data, size_t from, size_t to, int cls)
+{
+	// str_find_sse2() 32 bytes at a time
+	for (; from + 32 <= to; from += 32) 
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)(data + from));
+		__m256i ctl = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1F)), v),
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F))), _mm256_cmpgt_epi8(_mm256_setzero_si256(), v));
+		unsigned mask = _mm256_movemask_epi8(ctl);
+		
+		if (STR_PRINT == cls)
+			mask = ~mask;
+		else if (STR_WIDE == cls)
+			mask = ~mask & _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + from + 1)), 
+			_mm256_setzero_si256()));
+		
+		if (mask)
+			return from + __builtin_ctz(mask);
+	}
+	
+	return from;
 }
+#endif
 
 void print_file_info(const char * fname)
 {
 	// prints file size and last byte offset
-	FILE * fp;
-	long file_end;
-	
-	fp = open_file(fname, "rb");
-	fseek(fp, 0, SEEK_END);
-	file_end = ftell(fp);
+	SRC src;
+	OUT out;
+	off_t file_end;
 	
-	fprintf(stdout, "%-6s %.2f\n%-6s %.2f\n%-6s %ld\n", "MB:", (float)file_end / 1024.0 / 1024.0, "KB:", (float)file_end / 1024.0,
-	"Bytes:", file_end);
-	fprintf(stdout, "Last byte offset: %#lx\n", file_end - 1);
-	fprintf(stdout, "File ends at: %#lx\n", file_end);
+	src_open(&src, fname);
+	if (src.map || src.view)
+		file_end = src_size(&src);
+	else if (0 == fseeko(src.fp, 0, SEEK_END))
+		file_end = ftello(src.fp);
+	else
+	{
+		// a pipe has to be read to its end
+		const byte * data;
+		
+		while (src_next(&src, 0, &data) > 0)
+			continue;
+		file_end = src.pos;
+	}
 	
-	fclose(fp);
+	out_open(&out, STDOUT_FILENO);
+	file_info(&out, file_end);
+	out_close(&out);
+	src_close(&src);
+}
+
+void file_info(OUT * out, off_t file_end)
+{
+	// the lines of print_file_info() for a file of file_end bytes
+	out_printf(out, "%-6s %.2f\n%-6s %.2f\n%-6s %lld\n", "MB:", (double)file_end / 1024.0 / 1024.0, "KB:", (double)file_end / 1024.0,
+	"Bytes:", (long long)file_end);
+	out_printf(out, "Last byte offset: %#llx\n", (unsigned long long)(file_end - 1));
+	out_printf(out, "File ends at: %#llx\n", (unsigned long long)file_end);
 }
 
 void print_strlen(const char * str)
 {
 	// prints the length of str
-	fprintf(stdout, "%d\n", strlen(str));
+	fprintf(stdout, "%zu\n", strlen(str));
 }
 
 void check_hex_str(const char * num)
@@ -1088,31 +7624,34 @@ void print_ascii(const char * str, bool whole_table, bool reverse)
 	/* prints ASCII values by character, by number, 
 	 * or prints the whole ASCII table */
 	
+	OUT out;
 	int i, j;
 	
+	out_open(&out, STDOUT_FILENO);
+	
 	if (whole_table) // only -a or -ar with nothing after
 	{
 		int k, l, m, n;
 		
 		// printf the header
-		fprintf(stdout, "%-5s %-5s %-3s|", "Char", "Hex", "Dec");
-		fprintf(stdout, "%-5s %-5s %-3s|", "Char", "Hex", "Dec");
-		fprintf(stdout, "%-5s %-5s %-3s|", "Char", "Hex", "Dec");
-		fprintf(stdout, "%-5s %-5s %-3s\n", "Char", "Hex", "Dec");
-		fprintf(stdout, "---------------|");
-		fprintf(stdout, "---------------|");
-		fprintf(stdout, "---------------|");
-		fprintf(stdout, "---------------\n");
+		out_printf(&out, "%-5s %-5s %-3s|", "Char", "Hex", "Dec");
+		out_printf(&out, "%-5s %-5s %-3s|", "Char", "Hex", "Dec");
+		out_printf(&out, "%-5s %-5s %-3s|", "Char", "Hex", "Dec");
+		out_printf(&out, "%-5s %-5s %-3s\n", "Char", "Hex", "Dec");
+		out_printf(&out, "---------------|");
+		out_printf(&out, "---------------|");
+		out_printf(&out, "---------------|");
+		out_printf(&out, "---------------\n");
 		
 		// first line is special case because of space
 		i = 0; j = 32;
 		k = i + j;
 		l = k + j;
 		m = l + j;
-		fprintf(stdout, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[i], i, i);
-		fprintf(stdout, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[32], k, k); // "Space", k, k
-		fprintf(stdout, "  %-3c %-#5X %-3d|", l, l, l);
-		fprintf(stdout, "  %-3c %-#5X %-3d\n", m, m, m);
+		out_printf(&out, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[i], i, i);
+		out_printf(&out, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[32], k, k); // "Space", k, k
+		out_printf(&out, "  %-3c %-#5X %-3d|", l, l, l);
+		out_printf(&out, "  %-3c %-#5X %-3d\n", m, m, m);
 		
 		for (i = 1, n = j - 1; i < n; ++i) 
 		{
@@ -1120,10 +7659,10 @@ void print_ascii(const char * str, bool whole_table, bool reverse)
 			k = i + j;
 			l = k + j;
 			m = l + j;
-			fprintf(stdout, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[i], i, i);
-			fprintf(stdout, "  %-3c %-#5X %-3d|", k, k, k);
-			fprintf(stdout, "  %-3c %-#5X %-3d|", l, l, l);
-			fprintf(stdout, "  %-3c %-#5X %-3d\n", m, m, m);
+			out_printf(&out, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[i], i, i);
+			out_printf(&out, "  %-3c %-#5X %-3d|", k, k, k);
+			out_printf(&out, "  %-3c %-#5X %-3d|", l, l, l);
+			out_printf(&out, "  %-3c %-#5X %-3d\n", m, m, m);
 
 		}
 		
@@ -1131,17 +7670,18 @@ void print_ascii(const char * str, bool whole_table, bool reverse)
 		k = i + j;
 		l = k + j;
 		m = l + j;
-		fprintf(stdout, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[i], i, i);
-		fprintf(stdout, "  %-3c %-#5X %-3d|", k, k, k);
-		fprintf(stdout, "  %-3c %-#5X %-3d|", l, l, l);
-		fprintf(stdout, "%-5s %-#5X %-3d\n", "(del)", m, m);
+		out_printf(&out, "%-5s %-#5X %-3d|", NON_PRINT_ASCII[i], i, i);
+		out_printf(&out, "  %-3c %-#5X %-3d|", k, k, k);
+		out_printf(&out, "  %-3c %-#5X %-3d|", l, l, l);
+		out_printf(&out, "%-5s %-#5X %-3d\n", "(del)", m, m);
 		
+		out_close(&out);
 		exit(0);
 	}
 	
 	// print header
-	fprintf(stdout, "%-5s %-5s %-3s\n", "Char", "Hex", "Dec");
-	fprintf(stdout, "---------------\n");
+	out_printf(&out, "%-5s %-5s %-3s\n", "Char", "Hex", "Dec");
+	out_printf(&out, "---------------\n");
 	
 	// -ar <number(s)>
 	if (reverse)
@@ -1180,24 +7720,27 @@ void print_ascii(const char * str, bool whole_table, bool reverse)
 			
 			if (127 < num) // check boundry
 			{
+				out_flush(&out); // keep the order on a terminal
 				fprintf(stderr, "Err: %s%s is outside of the ASCII table.\n", (16 == base) ? "0x" : "", buff_str);
 				continue;
 			}
 				
 			if (32 >= num)
-				fprintf(stdout, "%-5s %-#5X %-3d\n", NON_PRINT_ASCII[num], num, num);
+				out_printf(&out, "%-5s %-#5X %-3d\n", NON_PRINT_ASCII[num], num, num);
 			else
-				fprintf(stdout, "  %-3c %-#5X %-3d\n", num, num, num);
+				out_printf(&out, "  %-3c %-#5X %-3d\n", num, num, num);
 			}
 		}
 		
+		out_close(&out);
 		return;
 	}
 	
 	// -a <character(s)>
 	for (i = 0, j = strlen(str); i < j; ++i) 
-		fprintf(stdout, "  %-3c %-#5X %-3d\n", str[i], str[i], str[i]);
+		out_printf(&out, "  %-3c %-#5X %-3d\n", str[i], str[i], str[i]);
 	
+	out_close(&out);
 }
 
 void print_help(const char * exe_name)
@@ -1205,9 +7748,11 @@ void print_help(const char * exe_name)
 	// prints help information
 	fprintf(stdout, "\n-------------------- General --------------------\n");
 	fprintf(stdout, "%s is a terminal hex editor.\n", ORIG_EXE_NAME);
-	fprintf(stdout, "File size limit is 2GB.\n");
 	fprintf(stdout, "Number conversion limit is unsigned long long.\n");
 	fprintf(stdout, "And, Or, Xor, and Not operations are limited to unsigned long.\n");
+	fprintf(stdout, "A <file> of - is stdin, or stdout for output files, i.e.\n");
+	fprintf(stdout, "zcat img.gz | %s - -%c <offset> reads from a pipe. A pipe can't seek, so\n", exe_name, OFFSET);
+	fprintf(stdout, "the bytes before <offset> are skipped. Replacing needs a real file.\n");
 	fprintf(stdout, "\n-------------------- Hex Dumps --------------------\n");
 	fprintf(stdout, "Note: Offset must be in hex. '0x' prefix can be omitted.\n");
 	fprintf(stdout, "Number of lines must be in decimal.\n\n");
@@ -1221,6 +7766,15 @@ void print_help(const char * exe_name)
 	fprintf(stdout, "-%c and -%c are 0 by default and can be omitted.\n", OFFSET, LN_NUM);
 	fprintf(stdout, "-%c 0 dumps from <offset> untill EOF.\n", LN_NUM);
 	fprintf(stdout, "To write the hex dump to a file use redirection.\n\n");
+	fprintf(stdout, "%s <file> -%c <offset>:<n>,<offset>:<n>,...\n", exe_name, WINDOW);
+	fprintf(stdout, "Dumps every window like -%c <offset> -%c <n> in one run. <n> can be\n", OFFSET, LN_NUM);
+	fprintf(stdout, "negative, or m<n> like -lm, but not 0. Only the bytes of the windows\n");
+	fprintf(stdout, "are read, and nothing is dumped if one of them is bad.\n");
+	fprintf(stdout, "-%c%c leaves out the offset headers on stderr.\n\n", WINDOW, NOT);
+	fprintf(stdout, "%s -%c <file a> <file b>\n", exe_name, DIFF);
+	fprintf(stdout, "Prints the lines which differ between <file a> and <file b> side by side\n");
+	fprintf(stdout, "with their offset, then the changed ranges. Changes less than a line\n");
+	fprintf(stdout, "apart are one range. -%c edits <file a> first, see Editing.\n\n", EDIT);
 	fprintf(stdout, "%s -%c <file> <csv file>\n", exe_name, CSV);
 	fprintf(stdout, "Writes a csv hex dump of <file> to <csv file>.\n");
 	fprintf(stdout, "\n-------------------- Binary --------------------\n");
@@ -1230,29 +7784,89 @@ void print_help(const char * exe_name)
 	fprintf(stdout, "%s <file> -%c%c \"string\" -%c <offset>\n", exe_name, SRCH, ASCII, OFFSET);
 	fprintf(stdout, "%s <file> -%c <offset> -%c%c \"string\"\n", exe_name, OFFSET, SRCH, ASCII);
 	fprintf(stdout, "Searches for ASCII strings from <offset>.\n\n");
-	fprintf(stdout, "-%c%c looks for Unicode strings.\n", SRCH, UNICODE);
-	fprintf(stdout, "Note: this options can detect Unicode strings in English only.\n");
-	fprintf(stdout, "For other languages convert the string to binary and use -%c%c.\n\n", SRCH, BIN);
+	fprintf(stdout, "-%c%c looks for UTF-16LE strings, -%c%cbe for UTF-16BE and -%c%c8 for UTF-8.\n", 
+	SRCH, UNICODE, SRCH, UNICODE, SRCH, UNICODE);
+	fprintf(stdout, "-%c%c%s looks for all three at once, in one thread without -%c.\n", SRCH, UNICODE, ENC_ALL_NAME, JOBS);
+	fprintf(stdout, "-%c%c%c and -%c%c%c ignore the case of ASCII letters, i.e. -%c%c%cbe \"password\".\n\n", 
+	SRCH, ASCII, NOCASE, SRCH, UNICODE, NOCASE, SRCH, UNICODE, NOCASE);
 	fprintf(stdout, "-%c%c searches for byte sequence.\n", SRCH, BIN);
 	fprintf(stdout, "The byte sequence must be presented as a string of hex values.\n");
 	fprintf(stdout, "i.e. %s <file> -%c%c 48656c6c6f -%c <offset>\n", exe_name, SRCH, BIN, OFFSET);
 	fprintf(stdout, "%s <file> -%c%c \"48 65 6c 6c 6f\" -%c <offset> is valid as well.\n", exe_name, SRCH, BIN, OFFSET);
-	fprintf(stdout, "Capital letters are also accepted.\n");
+	fprintf(stdout, "Capital letters are also accepted.\n\n");
+	fprintf(stdout, "-%c <n> splits the search, the hex dump or the csv dump of a regular file\n", JOBS);
+	fprintf(stdout, "between <n> threads.\n");
+	fprintf(stdout, "-%c 0 starts one thread per cpu.\n", JOBS);
+	fprintf(stdout, "\n-%c%c searches for a byte pattern, i.e.\n", SRCH, PATTERN);
+	fprintf(stdout, "%s <file> -%c%c \"4D 5A ?? ?? {0-508} \\\"PE\\\"\"\n", exe_name, SRCH, PATTERN);
+	fprintf(stdout, "HH is a byte, ?? is any byte, H? and ?L match one nibble.\n");
+	fprintf(stdout, "[HH HH-HH] is a set of bytes and ranges, [^...] is every other byte.\n");
+	fprintf(stdout, "{n} skips n bytes, {n-m} skips n to m bytes. \"text\" is ASCII.\n");
+	fprintf(stdout, "a | b matches either, ( ) groups. Matches are reported where they start.\n");
+	fprintf(stdout, "-%c%c runs in one thread, it doesn't take -%c.\n", SRCH, PATTERN, JOBS);
+	fprintf(stdout, "\n%s <file> -%c%c <pattern file>\n", exe_name, SRCH, SIG_FILE);
+	fprintf(stdout, "Searches for every pattern in <pattern file> at once. Every line is\n");
+	fprintf(stdout, "%c <string>, %c <string> or %c <hex bytes> like -s%c, -s%c and -s%c. Empty lines\n", 
+	ASCII, UNICODE, BIN, ASCII, UNICODE, BIN);
+	fprintf(stdout, "and lines starting with # are skipped. Every match shows the number\n");
+	fprintf(stdout, "of its pattern. %c can be %cbe or %c8, like -%c%cbe and -%c%c8.\n", UNICODE, UNICODE, UNICODE,
+	SRCH, UNICODE, SRCH, UNICODE);
+	fprintf(stdout, "-%c%c runs in one thread, it doesn't take -%c.\n", SRCH, SIG_FILE, JOBS);
+	fprintf(stdout, "\n%s <file> -%c build\n", exe_name, INDEX);
+	fprintf(stdout, "Writes a search index of <file> to <file>%s. Searches of <file>\n", IDX_EXT);
+	fprintf(stdout, "then read only the parts the index points to. The index is ignored\n");
+	fprintf(stdout, "once <file> changes, and it can't help where the data is random,\n");
+	fprintf(stdout, "with -%c%c, or with sequences shorter than 4 bytes.\n", REPLACE, EVERYTHING);
+	fprintf(stdout, "-%c%c searches without the index.\n", INDEX, NOT);
 	fprintf(stdout, "\n-------------------- Replacing --------------------\n");
 	fprintf(stdout, "Note: What's in the original file gets overwritten permanently.\n\n");
 	fprintf(stdout, "%s <file> -%c%c \"string\" -%c <offset>\n", exe_name, REPLACE, ASCII, OFFSET);
 	fprintf(stdout, "%s <file> -%c <offset> -%c%c \"string\"\n", exe_name, OFFSET, REPLACE, ASCII);
 	fprintf(stdout, "Writes an ASCII string over the original contents starting from <offset>.\n\n");
-	fprintf(stdout, "-%c%c writes an Unicode string.\n", REPLACE, UNICODE);
-	fprintf(stdout, "Note: English only.\n");
-	fprintf(stdout, "For other languages convert the string to binary and use -%c%c.\n\n", REPLACE, BIN);
+	fprintf(stdout, "-%c%c writes a UTF-16LE string, -%c%cbe a UTF-16BE and -%c%c8 a UTF-8 one.\n\n", 
+	REPLACE, UNICODE, REPLACE, UNICODE, REPLACE, UNICODE);
 	fprintf(stdout, "-%c%c writes a byte sequence.\n", REPLACE, BIN);
+	fprintf(stdout, "\n-------------------- Undo --------------------\n");
+	fprintf(stdout, "-%c with a replace or -%c%c keeps the old bytes in <file>%s first.\n", JOURNAL, REPLACE, EVERYTHING, JRN_EXT);
+	fprintf(stdout, "Once it's there, every replace goes in it, with or without -%c.\n", JOURNAL);
+	fprintf(stdout, "%s <file> %s - puts back the bytes of the last replace.\n", exe_name, UNDO);
+	fprintf(stdout, "%s <file> %s - writes again the last undone replace, if no replace\n", exe_name, REDO);
+	fprintf(stdout, "came after it.\n");
+	fprintf(stdout, "%s <file> %s - keeps the changes and removes the journal.\n", exe_name, COMMIT);
+	fprintf(stdout, "\n-------------------- Editing --------------------\n");
+	fprintf(stdout, "Note: <file> itself is never changed, edits live in memory for one run.\n\n");
+	fprintf(stdout, "%s <file> -%c \"%c10=aabb,%c20+8,%c0=ff\" <options>\n", exe_name, EDIT, EDIT_INS, EDIT_DEL, EDIT_OVR);
+	fprintf(stdout, "Dumps, searches and -%c see <file> with the edits made, in order:\n", INFO);
+	fprintf(stdout, "%c<offset>=<hex bytes> inserts, %c<offset>+<length> deletes and\n", EDIT_INS, EDIT_DEL);
+	fprintf(stdout, "%c<offset>=<hex bytes> overwrites. Offsets and lengths are in hex and\n", EDIT_OVR);
+	fprintf(stdout, "point in the file as the edits before them left it.\n");
+	fprintf(stdout, "%s <file> -%c <edits> %s <new file> - writes the edited file to <new file>.\n", exe_name, EDIT, SAVE);
+	fprintf(stdout, "The unchanged parts are copied by the kernel where it can.\n");
 	fprintf(stdout, "\n-------------------- Search and Replace --------------------\n");
 	fprintf(stdout, "%s <file> -%c%c \"search string\" -%c%c \"replace string\"\n", exe_name, SRCH, ASCII, REPLACE, EVERYTHING);
 	fprintf(stdout, "Looks for ASCII \"search string\" in <file> and replaces every\n");
 	fprintf(stdout, "found instance with ASCII \"replace string\".\n");
 	fprintf(stdout, "-%c%c -%c%c and -%c%c -%c%c work for Unicode and byte sequences respectively.\n", SRCH, UNICODE,
 	REPLACE, EVERYTHING, SRCH, BIN, REPLACE, EVERYTHING);
+	fprintf(stdout, "With -%c%c, -%c%cbe and -%c%c8 \"replace string\" is written in the same encoding.\n", 
+	SRCH, UNICODE, SRCH, UNICODE, SRCH, UNICODE);
+	fprintf(stdout, "\n-------------------- Server --------------------\n");
+	fprintf(stdout, "%s %s <socket> - answers requests on a unix socket, one per line:\n", exe_name, SERVE);
+	fprintf(stdout, "dump <file> <offset>:<n>,...   - dumps windows like -%c%c\n", WINDOW, NOT);
+	fprintf(stdout, "search <file> <options>        - like %s <file> <options> with -%c\n", exe_name, SRCH);
+	fprintf(stdout, "replace <file> <options>       - like %s <file> <options> with -%c or -%c%c\n", exe_name, 
+	REPLACE, REPLACE, EVERYTHING);
+	fprintf(stdout, "info <file>                    - like -%c\n", INFO);
+	fprintf(stdout, "quit                           - closes the connection\n");
+	fprintf(stdout, "Words with spaces go in double quotes. Every response ends with a line\n");
+	fprintf(stdout, "holding only a dot. Files stay mapped and responses are cached until\n");
+	fprintf(stdout, "the file changes. Paths are relative to where the server started.\n");
+	fprintf(stdout, "\n-------------------- Patches --------------------\n");
+	fprintf(stdout, "%s %s <old file> <new file> <patch> - writes the changes which make\n", exe_name, MKPATCH);
+	fprintf(stdout, "<new file> out of <old file> to <patch>, as copies of <old file> ranges, found\n");
+	fprintf(stdout, "even where they moved, and the bytes that aren't in <old file>.\n");
+	fprintf(stdout, "%s %s <old file> <patch> <new file> - makes <new file> again. The patch\n", exe_name, APPLY);
+	fprintf(stdout, "works only with the <old file> it was made from, and it can be a pipe.\n");
 	fprintf(stdout, "\n-------------------- ASCII --------------------\n");
 	fprintf(stdout, "%s -%c \"string\"\n", exe_name, ASCII);
 	fprintf(stdout, "Prints the ASCII value for every character in \"string\".\n");
@@ -1283,6 +7897,17 @@ void print_help(const char * exe_name)
 	fprintf(stdout, "Unsigned values only.\n");
 	fprintf(stdout, "\n-------------------- Other --------------------\n");
 	fprintf(stdout, "%s <file> -%c - prints file size info.\n", exe_name, INFO);
+	fprintf(stdout, "%s <file> -%c [<hash>,...] - prints the checksums of <file>, all of them if\n", exe_name, HASH);
+	fprintf(stdout, "no <hash> is given: crc32, crc32c, adler32, xxh64 and sha256. -%c and -%c hash\n", OFFSET, LN_NUM);
+	fprintf(stdout, "the bytes they would dump. All of them take one pass, -%c splits it.\n", JOBS);
+	fprintf(stdout, "%s <file> -%c [<block size>] - prints how many times every byte value is\n", exe_name, STATS);
+	fprintf(stdout, "in <file>, its entropy and the entropy of every <block size> bytes, %d\n", STAT_BLK);
+	fprintf(stdout, "by default, in columns for plotting. It takes -%c, -%c and -%c like -%c.\n", OFFSET, LN_NUM, JOBS, HASH);
+	fprintf(stdout, "%s <file> -%c [<min length>] - prints the offset of every run of at least\n", exe_name, STRINGS);
+	fprintf(stdout, "<min length> chars, %d by default, that the char column shows as they are, with\n", STR_MIN);
+	fprintf(stdout, "%c for ASCII and %c for UTF-16LE. It takes -%c, -%c and -%c like -%c.\n", ASCII, UNICODE, OFFSET, LN_NUM, JOBS, HASH);
+	fprintf(stdout, "Regular files bigger than %ldMB are read through a memory map.\n", MAP_MIN / 1024 / 1024);
+	fprintf(stdout, "-%c maps <file> regardless of its size, -%c%c never maps it.\n", MAP, MAP, NOT);
 	fprintf(stdout, "%s -%c%c \"string\" - prints the length of \"string\".\n", exe_name, STRING, LEN);
 	fprintf(stdout, "%s -%c for help.\n", exe_name, HELP);
 	fprintf(stdout, "%s -%c for version info.\n", exe_name, VER);
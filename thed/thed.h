@@ -1,13 +1,82 @@
+// copy_file_range()
+#define _GNU_SOURCE
+// 64 bit off_t, fseeko() and ftello() on 32 bit builds as well
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+
+// SIMD kernels are picked at run time, so the build needs no -m flags
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(THED_NO_SIMD)
+#include <immintrin.h>
+#define X86_SIMD
+#endif
 
 #define MAX 16
 #define MAGIC 10
 #define CSV_LN_LEN (MAX * 5 + 2)
+#define BLK_SIZE (1 << 20)
+#define MAP_MIN (1L << 24)
+#define PAR_CHUNK (1 << 24)
+#define MAX_JOBS 256
+#define DUMP_SEG (1 << 18)
+#define SERVE "--serve"
+#define JRN_EXT ".thj"
+#define JRN_MAGIC "THEDJRN1"
+#define JRN_BATCH (1 << 23)
+#define JRN_BEGIN 1
+#define JRN_WRITE 2
+#define JRN_END 3
+#define JRN_UNDO 4
+#define JRN_REDO 5
+#define SRV_CLIENTS 16
+#define SRV_FILES 8
+#define SRV_CACHE 32
+#define SRV_CACHE_MAX (1 << 20)
+#define SRV_LINE (1 << 16)
+#define SRV_ARGS 64
+#define SRV_END ".\n"
+#define SRV_END_LEN 2
+#define HEX_LN_LEN (MAX * 4 + 2)
+#define HEX_BATCH 4096
+#define OUT_SIZE (1 << 22)
+#define NOT_HEX 0xFF
+#define IDX_BLK (1 << 16)
+#define IDX_BITS 20
+#define IDX_DENSE (1 << 15)
+#define IDX_GRAMS 8
+#define IDX_EXT ".thx"
+#define IDX_MAGIC "THEDIDX1"
+#define PAT_MAX_GAP (1 << 16)
+#define PAT_OR '|'
+#define DFA_STATES 4096
+#define DFA_HASH (DFA_STATES * 2)
+#define PN_CLASS 0
+#define PN_CAT 1
+#define PN_ALT 2
+#define PN_GAP 3
+#define NFA_CLASS 0
+#define NFA_SPLIT 1
+#define NFA_MATCH 2
 #define BIN 'b'
 #define CSV 'c'
 #define OFFSET 'o'
@@ -25,6 +94,70 @@
 #define REVERSE 'r'
 #define EVERYTHING 'e'
 #define MIDDLE 'm'
+#define MAP 'm'
+#define WINDOW 'w'
+#define JOURNAL 'J'
+#define UNDO "-undo"
+#define REDO "-redo"
+#define COMMIT "-commit"
+#define SAVE "-save"
+#define MKPATCH "-mkpatch"
+#define APPLY "-apply"
+#define DELTA_MAGIC "THEDDLT1"
+#define DELTA_BLK 32
+#define DELTA_BLOCKS (1 << 22)
+#define DELTA_MUL 0x01000193u
+#define DELTA_END 0
+#define DELTA_COPY 1
+#define DELTA_ADD 2
+#define EDIT 'e'
+#define DIFF 'd'
+#define HASH 'H'
+#define STATS 'E'
+#define STAT_BLK 4096
+#define STRINGS 'S'
+#define STR_MIN 4
+#define STR_SEG (1 << 22)
+#define STR_PRINT 0
+#define STR_CTRL 1
+#define STR_WIDE 2
+#define HASH_CRC32 1
+#define HASH_CRC32C 2
+#define HASH_ADLER 4
+#define HASH_XXH64 8
+#define HASH_SHA256 16
+#define HASH_ALL 31
+#define HASH_ALGS 5
+#define HASH_PIECE (1 << 16)
+#define HASH_PAR_MIN (1 << 22)
+#define CRC32_POLY 0xEDB88320u
+#define CRC32C_POLY 0x82F63B78u
+#define ADLER_BASE 65521u
+#define ADLER_NMAX 5552
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+#define SHA_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA_E0(x) (SHA_ROR(x, 2) ^ SHA_ROR(x, 13) ^ SHA_ROR(x, 22))
+#define SHA_E1(x) (SHA_ROR(x, 6) ^ SHA_ROR(x, 11) ^ SHA_ROR(x, 25))
+#define SHA_S0(x) (SHA_ROR(x, 7) ^ SHA_ROR(x, 18) ^ ((x) >> 3))
+#define SHA_S1(x) (SHA_ROR(x, 17) ^ SHA_ROR(x, 19) ^ ((x) >> 10))
+#define DIFF_OFF_LEN 15
+#define EDIT_INS 'i'
+#define EDIT_DEL 'd'
+#define EDIT_OVR 'w'
+#define JOBS 'j'
+#define INDEX 'x'
+#define PATTERN 'p'
+#define SIG_FILE 'f'
+#define NOCASE 'i'
+#define ENC_LE 0
+#define ENC_BE 1
+#define ENC_UTF8 2
+#define ENC_ALL 3
+#define ENC_ALL_NAME "all"
 #define INFO 'i'
 #define TO 't'
 #define HEX 'h'
@@ -45,6 +178,19 @@
 #define OPT_AND_OR_XOR 12
 #define OPT_HELP 13
 #define OPT_VER 14
+#define OPT_IDX_BUILD 15
+#define OPT_WINDOWS 16
+#define OPT_SERVE 17
+#define OPT_UNDO 18
+#define OPT_REDO 19
+#define OPT_COMMIT 20
+#define OPT_SAVE 21
+#define OPT_DIFF 22
+#define OPT_MKPATCH 23
+#define OPT_APPLY 24
+#define OPT_HASH 25
+#define OPT_STATS 26
+#define OPT_STRINGS 27
 #define BAD_OPT -1
 
 #define hex_chars_to_byte(chars_ptr, out_byte_ptr)\
@@ -82,10 +228,23 @@ const char * NON_PRINT_ASCII[] =	{
 const char OFFSET_TBL[] = " 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F";									
 const char HEXTBL[] = "0123456789ABCDEF";
 const char ORIG_EXE_NAME[] = "thed";
-const char EXE_VER[] = "1.01";
+const char EXE_VER[] = "1.02";
 const char DASH = '-';
 const char END = '_';
 const char SPRT = '|';
+const char * ENC_NAME[] = {"UTF-16LE", "UTF-16BE", "UTF-8"};
+// in the order of the HASH_ flags
+const char * HASH_NAME[] = {"crc32", "crc32c", "adler32", "xxh64", "sha256"};
+const uint32_t SHA_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+							};
 
 // globals for program arguments
 static const char * input_file = NULL;
@@ -93,16 +252,51 @@ static const char * output_file = NULL;
 static const char * search_rep_seq = NULL;
 static const char * srch_rep_mode = NULL;
 static const char * replace_only_seq = NULL;
-static long offset = 0L;
-static long line_num = 0L;
+static off_t offset = 0;
+static long long line_num = 0LL;
+static int jobs = 1;
+static int encoding = ENC_LE;
+static const char * windows = NULL;
+static bool window_header = true;
+static const char * serve_path = NULL;
+static bool journal = false;
+static const char * edits = NULL;
+static const char * diff_file = NULL;
+static int hash_algs = HASH_ALL;
+static long long stat_blk = STAT_BLK;
+static long long str_min = STR_MIN;
 static int from_base = 0;
 static int to_base = 0;
 bool replace_everything = false;
+static bool no_case = false;
 bool negative_line = false;
 bool hex_dump_middle = false;
+bool map_force = false;
+bool map_never = false;
+bool idx_never = false;
 
 typedef uint8_t byte;
 
+// value of every hex digit character, 0xFF for all other characters
+const byte HEX_VAL[] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 10, 11, 12, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+						};
+
 // the LINE struct acts as a char buffer for a one hex view line
 struct LINE
 {
@@ -111,20 +305,595 @@ struct LINE
 };
 typedef struct LINE LINE;
 
+// the SRC struct is an input file read either through stdio or a memory map
+// the PIECE struct is a run of bytes of a VIEW, from the file or from the added bytes
+struct PIECE
+{
+	off_t start;		// where the run starts in the file or in the add buffer
+	off_t len;
+	bool is_add;
+};
+typedef struct PIECE PIECE;
+
+// the VIEW struct is the piece table of a file edited by -e
+struct VIEW
+{
+	const char * fname;
+	FILE * fp;
+	const byte * map;	// the file, read-only
+	byte * add;			// every inserted byte, in the order of the edits
+	size_t add_len;
+	size_t add_cap;
+	PIECE * pieces;		// the edited file is these runs one after the other
+	int count;
+	int cap;
+	off_t size;			// size of the edited file
+};
+typedef struct VIEW VIEW;
+
+struct SRC
+{
+	FILE * fp;
+	const VIEW * view;	// the edited file if -e was given for it, NULL otherwise
+	const byte * map;	// the whole file if it's mapped, NULL otherwise
+	off_t size;			// size of the mapping
+	off_t pos;			// offset of the next block
+	off_t skip;			// bytes to drop before the next block, pipes can't seek
+	byte * buff;		// block buffer for the stdio backend
+	size_t buff_len;	// bytes in buff after the last src_next()
+	size_t buff_cap;
+};
+typedef struct SRC SRC;
+
+// the OUT struct is a big output buffer written straight to a file descriptor
+struct OUT
+{
+	int fd;
+	char * buff;
+	size_t len;
+};
+typedef struct OUT OUT;
+
+// the SRCH_PAT struct holds a search sequence prepared for the block scanner
+struct SRCH_PAT
+{
+	byte * seq;			// the bytes to look for
+	int len;
+	int skip[256];		// Boyer-Moore-Horspool shift for each last window byte
+	byte * fold;		// NULL, or 0x20 for every letter whose case is ignored
+};
+typedef struct SRCH_PAT SRCH_PAT;
+
+// the JRN_REC struct starts every record of a journal, the old and the new bytes follow it
+struct JRN_REC
+{
+	uint32_t type;		// JRN_BEGIN, JRN_WRITE, JRN_END, JRN_UNDO or JRN_REDO
+	uint32_t txn;		// every replace is a transaction
+	uint64_t off;		// where the bytes were written, the file size for JRN_BEGIN
+	uint64_t old_len;	// can be less than new_len past the eof
+	uint64_t new_len;
+};
+typedef struct JRN_REC JRN_REC;
+
+// the JRN struct is a journal open for a replace
+struct JRN
+{
+	FILE * fp;
+	char * name;
+	int fd;				// the file being replaced in
+	uint32_t txn;
+	byte * pend;		// writes held back until the journal is synced
+	size_t pend_len;
+	size_t pend_cap;
+};
+typedef struct JRN JRN;
+
+// the PATCH struct gathers the writes of a replace into runs of adjacent bytes
+struct PATCH
+{
+	FILE * fp;
+	byte * seq;			// the replace sequence
+	int len;
+	byte * run;			// bytes waiting to be written at run_start
+	off_t run_start;
+	size_t run_len;
+	size_t run_cap;
+	bool is_jrn;		// the writes go through jrn
+	JRN jrn;
+};
+typedef struct PATCH PATCH;
+
+// the SRCH_JOB struct is one chunk of a parallel search
+struct SRCH_JOB
+{
+	const SRCH_PAT * pat;
+	const SRC * src;
+	off_t start;		// first offset a match can start at
+	off_t end;			// matches must start before end
+	off_t file_end;
+	byte * buff;		// chunk buffer when the file isn't mapped
+	uint32_t * matches;	// match offsets relative to start
+	size_t count;
+	size_t cap;
+};
+typedef struct SRCH_JOB SRCH_JOB;
+
+// the DUMP_JOB struct is one segment of a parallel dump
+struct DUMP_JOB
+{
+	const SRC * src;
+	off_t start;
+	size_t len;			// whole lines only
+	bool csv;			// csv_lines() instead of hex_lines()
+	byte * buff;		// segment buffer when the file isn't mapped
+	char * text;		// the formatted segment
+	size_t text_len;
+};
+typedef struct DUMP_JOB DUMP_JOB;
+
+// the SRV_ENTRY struct is a response the server keeps for a request line
+struct SRV_ENTRY
+{
+	char * req;			// NULL if the entry is free
+	char * resp;
+	size_t len;
+};
+typedef struct SRV_ENTRY SRV_ENTRY;
+
+// the SRV_FILE struct is a file the server keeps open, with its cached responses
+struct SRV_FILE
+{
+	char * path;		// NULL if the slot is free
+	SRC src;
+	struct stat st;		// the file when it was opened, a change drops it
+	SRV_ENTRY cache[SRV_CACHE];
+	int next;			// the entry to replace next
+};
+typedef struct SRV_FILE SRV_FILE;
+
+// the SRV_CLIENT struct is a connection to the server
+struct SRV_CLIENT
+{
+	int fd;				// -1 if the slot is free
+	char * buff;		// bytes of requests which aren't answered yet
+	size_t len;
+};
+typedef struct SRV_CLIENT SRV_CLIENT;
+
+// the IDX_HDR struct starts an index file, the indexed file is known by its size and mtime
+struct IDX_HDR
+{
+	char magic[8];
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t blk_size;
+	uint32_t bits;		// a gram hashes to one of 1 << bits posting lists
+	uint64_t blocks;
+};
+typedef struct IDX_HDR IDX_HDR;
+
+// the IDX struct is a mapped index file
+struct IDX
+{
+	const byte * map;
+	size_t map_len;
+	const IDX_HDR * hdr;
+	const uint64_t * dense;	// a bit for every block with too many grams to list
+	const uint64_t * dir;	// start of every posting list, and the end of the last one
+	const byte * post;		// block numbers as varint deltas
+};
+typedef struct IDX IDX;
+
+// the IDX_LIST struct is one posting list while the index is built
+struct IDX_LIST
+{
+	byte * buff;
+	uint32_t len;
+	uint32_t cap;
+	uint64_t last;		// the last block in the list
+};
+typedef struct IDX_LIST IDX_LIST;
+
+// the PAT_NODE struct is a node of a parsed -sp pattern
+struct PAT_NODE
+{
+	int type;			// PN_CLASS, PN_CAT, PN_ALT or PN_GAP
+	uint64_t cls[4];	// a bit for every byte a PN_CLASS node matches
+	int min;			// length range of a PN_GAP node
+	int max;
+	struct PAT_NODE ** kids;
+	int count;
+};
+typedef struct PAT_NODE PAT_NODE;
+
+// the NFA_ST struct is one state of a pattern's nfa
+struct NFA_ST
+{
+	int type;			// NFA_CLASS reads a byte in cls, NFA_SPLIT goes to both outs
+	int out;
+	int out1;
+	uint64_t cls[4];
+};
+typedef struct NFA_ST NFA_ST;
+
+// the SRCH_DFA struct is a dfa built from the nfa one state at a time while scanning
+struct SRCH_DFA
+{
+	NFA_ST * nfa;
+	int nfa_len;
+	int nfa_cap;
+	int start;			// nfa start state
+	bool floating;		// the pattern starts over at every byte
+	int first;			// dfa state before any input, -1 if not built yet
+	int * next;			// 256 transitions for every dfa state, -1 if not built yet
+	byte * accept;		// the state has matched the pattern
+	byte * dead;		// the state can't match anymore
+	int * sets;			// the nfa states of every dfa state
+	size_t sets_len;
+	size_t sets_cap;
+	size_t * set_at;
+	int * set_len;
+	int * hash;			// dfa state of each set hash, -1 if empty
+	int count;
+	unsigned flushes;	// times the cache was dropped for being full
+	unsigned * mark;	// nfa states already in the set being built
+	unsigned gen;
+	int * list;
+	int * stack;
+	int * cur;
+};
+typedef struct SRCH_DFA SRCH_DFA;
+
+// the SIG_AC struct is the Aho-Corasick automaton of the -sf patterns
+struct SIG_AC
+{
+	byte ** seq;		// the patterns
+	int * len;
+	int count;
+	int max_len;
+	int cls[256];		// class of every byte, 0 if it's in no pattern
+	int classes;
+	int * delta;		// next state for every state and class, see sig_pack()
+	int * fail;			// longest proper suffix of every state which is a state as well
+	int * dict;			// longest proper suffix of every state which ends a pattern, or 0
+	int * head;			// first pattern which ends in every state, or -1
+	int * same;			// next pattern which ends in the same state, or -1
+	byte * hit;			// some pattern ends in the state or in one of its suffixes
+	const char ** names;	// name of every pattern, or NULL to show their numbers
+};
+typedef struct SIG_AC SIG_AC;
+
+// the SIG_MATCH struct is a -sf match waiting to be printed
+struct SIG_MATCH
+{
+	off_t pos;
+	int id;
+};
+typedef struct SIG_MATCH SIG_MATCH;
+
+// the DIFF_RANGE struct is a run of changed bytes, end is past the last one
+struct DIFF_RANGE
+{
+	off_t start;
+	off_t end;
+};
+typedef struct DIFF_RANGE DIFF_RANGE;
+
+// the DIFF_LIST struct collects the changed ranges of -d
+struct DIFF_LIST
+{
+	DIFF_RANGE * ranges;
+	int count;
+	int cap;
+	long long bytes;	// changed bytes, the ranges can have equal ones in them
+};
+typedef struct DIFF_LIST DIFF_LIST;
+
+// the DELTA_HDR struct starts a patch of -mkpatch, the ops come after it
+struct DELTA_HDR
+{
+	char magic[8];
+	uint64_t old_size;
+	uint64_t new_size;
+	uint32_t old_crc;
+	uint32_t new_crc;
+};
+typedef struct DELTA_HDR DELTA_HDR;
+
+// the XXH64_CTX struct is a running xxh64
+struct XXH64_CTX
+{
+	uint64_t v[4];		// the four lanes
+	byte buff[32];		// a stripe which isn't whole yet
+	size_t len;
+	uint64_t total;
+};
+typedef struct XXH64_CTX XXH64_CTX;
+
+// the SHA256_CTX struct is a running sha256
+struct SHA256_CTX
+{
+	uint32_t st[8];
+	byte buff[64];		// a block which isn't whole yet
+	size_t len;
+	uint64_t total;
+};
+typedef struct SHA256_CTX SHA256_CTX;
+
+// the HASH_CTX struct has every algorithm of -H
+struct HASH_CTX
+{
+	int algs;			// HASH_ flags of the ones in use
+	uint32_t crc32;
+	uint32_t crc32c;
+	uint32_t adler;
+	XXH64_CTX xxh;
+	SHA256_CTX sha;
+};
+typedef struct HASH_CTX HASH_CTX;
+
+// the HASH_JOB struct is a range hashed by one thread of hash_parallel()
+struct HASH_JOB
+{
+	const SRC * src;
+	off_t start;
+	off_t len;
+	HASH_CTX ctx;
+	byte * buff;		// pread() buffer when the file isn't mapped
+};
+typedef struct HASH_JOB HASH_JOB;
+
+// the STAT_JOB struct is a run of blocks of -E for one thread
+struct STAT_JOB
+{
+	const SRC * src;
+	off_t start;
+	off_t len;
+	long long blk;
+	const double * xlogx;	// c * log2(c) for c up to blk
+	double * ent;			// the entropy of every block goes here
+	uint64_t hist[256];
+};
+typedef struct STAT_JOB STAT_JOB;
+
+// the STR_RUN struct is a string found by -S
+struct STR_RUN
+{
+	size_t pos;
+	size_t len;			// in characters
+};
+typedef struct STR_RUN STR_RUN;
+
+// the STR_LIST struct is a growing array of STR_RUN
+struct STR_LIST
+{
+	STR_RUN * runs;
+	size_t count;
+	size_t cap;
+};
+typedef struct STR_LIST STR_LIST;
+
+// the STR_JOB struct is a segment of -S scanned by one thread
+struct STR_JOB
+{
+	const byte * data;
+	size_t len;			// a run can be read up to here
+	size_t lo;			// only runs which start between lo and hi are found
+	size_t hi;
+	bool at_end;		// data ends where the range does
+	long long min_len;
+	STR_LIST ascii;
+	STR_LIST wide;		// UTF-16LE
+};
+typedef struct STR_JOB STR_JOB;
+
+// slicing by 8 tables, see crc_tables()
+static uint32_t crc32_table[8][256];
+static uint32_t crc32c_table[8][256];
+
+// -e, see view_open()
+static VIEW view;
+static const VIEW * edit_view = NULL;
+
+// --serve, the file a request runs on, see srv_run()
+static const SRV_FILE * srv_kept = NULL;
+
 int check_args(int argc, char * argv[]);
+void run_opt(int opt, int argc, char * argv[]);
 FILE * open_file(const char * fname, const char * accs);
-void hex_dump(const char * fname, long line_num);
+bool is_std(const char * fname);
+void src_open(SRC * src, const char * fname);
+void src_seek(SRC * src, off_t pos);
+void src_skip(SRC * src);
+size_t src_next(SRC * src, size_t keep, const byte ** data);
+off_t src_size(SRC * src);
+size_t src_pread(const SRC * src, byte * buff, size_t len, off_t pos);
+void src_close(SRC * src);
+void run_jobs(void * (*job_fn)(void *), void * job_arr, size_t job_size, int n);
+void hex_dump(const char * fname, long long line_num);
+void hex_tail(OUT * out, const byte * buff, int len);
+void print_dump_header(off_t start);
+void hex_window(OUT * out, SRC * src, off_t start, long long lines, off_t file_end);
+void hex_windows(const char * fname, const char * list);
+bool window_parse(const char ** p, off_t * start, long long * lines);
+void out_open(OUT * out, int fd);
+char * out_reserve(OUT * out, size_t len);
+void out_write(OUT * out, const void * data, size_t len);
+void out_printf(OUT * out, const char * fmt, ...);
+void out_flush(OUT * out);
+void out_close(OUT * out);
+void write_all(int fd, const char * buff, size_t len);
 void csv_dump(const char * fin, const char * fout);
+size_t csv_lines(char * out, const byte * data, size_t len);
+long long dump_parallel(SRC * src, OUT * out, off_t stop, bool csv);
+void * dump_job(void * arg);
+size_t hex_lines(char * out, const byte * data, size_t lines);
+size_t hex_lines_scalar(char * out, const byte * data, size_t lines);
+#ifdef X86_SIMD
+size_t hex_lines_sse2(char * out, const byte * data, size_t lines);
+size_t hex_lines_ssse3(char * out, const byte * data, size_t lines);
+size_t hex_lines_avx2(char * out, const byte * data, size_t lines);
+#endif
 void hex_dump_to_bin(const char * fin, const char * fout);
+bool hex_line_to_bin(OUT * out, const byte * ln, size_t len, unsigned long long line);
+#ifdef X86_SIMD
+bool hex_line_decode_ssse3(const byte * ln, byte * bytes);
+#endif
 void csv_dump_to_bin(const char * fin, const char * fout);
+bool csv_line_to_bin(OUT * out, const byte * ln, size_t len, unsigned long long line);
+void diff_files(const char * fa, const char * fb);
+void diff_line(OUT * out, DIFF_LIST * diff, off_t off, const byte * da, int len_a, const byte * db, int len_b, unsigned mask);
+void diff_side(char * out, const byte * data, int len);
+void diff_add(DIFF_LIST * diff, off_t pos, off_t len);
+unsigned diff_mask(const byte * a, const byte * b, int len);
+size_t diff_first(const byte * a, const byte * b, size_t len);
+size_t diff_first_scalar(const byte * a, const byte * b, size_t len, size_t i);
+#ifdef X86_SIMD
+size_t diff_first_sse2(const byte * a, const byte * b, size_t len);
+size_t diff_first_avx2(const byte * a, const byte * b, size_t len);
+#endif
 void search(const char mode, const char * fname, const char * sequence);
+void srch_pat_init(SRCH_PAT * pat, const char mode, const char * sequence);
+void pat_search(const char * fname, const char * pattern);
+void pat_report(byte * pend, size_t win, off_t * done, off_t upto, unsigned long long * pending, unsigned long long * matches_found);
+PAT_NODE * pat_node(int type);
+void pat_add(PAT_NODE * node, PAT_NODE * kid);
+PAT_NODE * pat_byte(int val, int mask);
+PAT_NODE * pat_alt(const char ** s);
+PAT_NODE * pat_cat(const char ** s);
+void pat_item(PAT_NODE * cat, const char ** s);
+PAT_NODE * pat_set(const char ** s);
+void pat_len(const PAT_NODE * node, int * min, int * max);
+void pat_free(PAT_NODE * node);
+int nfa_add(SRCH_DFA * dfa, int type, int out, int out1, const uint64_t * cls);
+int nfa_build(SRCH_DFA * dfa, const PAT_NODE * node, int next, bool reverse);
+void dfa_init(SRCH_DFA * dfa, const PAT_NODE * root, bool reverse, bool floating);
+void dfa_flush(SRCH_DFA * dfa);
+void dfa_free(SRCH_DFA * dfa);
+void dfa_closure(SRCH_DFA * dfa, int st, int * len);
+int dfa_state(SRCH_DFA * dfa, int len);
+int dfa_first(SRCH_DFA * dfa);
+int dfa_step(SRCH_DFA * dfa, int s, byte b);
+void sig_search(const char * fname, const char * sig_file);
+void enc_search(const char * fname, const char * str);
+void sig_scan(SIG_AC * ac_ptr, const char * fname);
+size_t sig_report(const SIG_AC * ac, SIG_MATCH * found, size_t count, off_t upto, unsigned long long * matches_found);
+void sig_load(SIG_AC * ac, const char * sig_file);
+void sig_add(SIG_AC * ac, byte * seq, int len);
+void sig_build(SIG_AC * ac);
+void sig_pack(SIG_AC * ac, int states, int * queue);
+void sig_free(SIG_AC * ac);
+char * side_name(const char * fname, const char * ext);
+void idx_build(const char * fname);
+void idx_add_blk(IDX_LIST * lists, uint64_t * dense, uint64_t * seen, const uint32_t * grams, size_t count, uint64_t blk);
+bool idx_load(IDX * idx, const char * fname, SRC * src);
+void idx_free(IDX * idx);
+bool idx_search(const IDX * idx, const SRCH_PAT * pat, SRC * src, off_t file_end, unsigned long long * matches_found);
+void srch_fold(SRCH_PAT * pat, const char mode);
+void srch_pat_free(SRCH_PAT * pat);
+bool srch_scan(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos);
+bool srch_scan_fold(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos);
+#ifdef X86_SIMD
+bool srch_fold_sse2(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos);
+bool srch_fold_avx2(const SRCH_PAT * pat, const byte * data, size_t len, size_t * pos);
+#endif
+void srch_report(off_t pos, PATCH * patch);
+unsigned long long srch_parallel(const SRCH_PAT * pat, SRC * src, off_t file_end, PATCH * patch);
+void * srch_job(void * arg);
 void replace(const char mode, const char * fname, const char * sequence);
+void patch_open(PATCH * patch, const char mode, const char * fname, const char * sequence);
+void patch_add(PATCH * patch, off_t pos);
+void patch_flush(PATCH * patch, off_t upto);
+void patch_close(PATCH * patch);
+void pwrite_all(int fd, const byte * buff, size_t len, off_t pos);
+void jrn_open(JRN * jrn, int fd, const char * fname);
+void jrn_write(JRN * jrn, const byte * buff, size_t len, off_t pos);
+void jrn_sync(JRN * jrn);
+void jrn_close(JRN * jrn);
+void jrn_put(JRN * jrn, const JRN_REC * rec, const void * data, size_t len);
+void jrn_flush(JRN * jrn);
+size_t jrn_pread(int fd, byte * buff, size_t len, off_t pos);
+byte * jrn_load(const char * name, size_t * len);
+uint32_t jrn_last(const char * name, size_t * len);
+void jrn_undo(const char * fname, bool redo);
+void jrn_revert(int fd, const byte * jbuff, size_t from, size_t len, uint32_t txn);
+void jrn_commit(const char * fname);
+byte * seq_to_bytes(const char mode, const char * sequence, int * out_buff_size);
 void print_conv_nums(const char * str, int from_base, int to_base);
 void base_convert(unsigned long long num, int base);
 void print_ascii(const char * str, bool whole_table, bool reverse);
 byte * hexstr_to_bytes(const char * str, int * out_buff_size);
-char * astr_to_ucstr(const char * str, int * out_buff_size);
+byte * str_to_enc(const char * str, int enc, int * out_buff_size);
+int get_encoding(const char * name);
+void edit_open(int opt);
+void view_open(VIEW * v, const char * fname, const char * list);
+void view_room(VIEW * v);
+int view_split(VIEW * v, off_t off);
+void view_insert(VIEW * v, off_t off, const byte * bytes, size_t len);
+void view_delete(VIEW * v, off_t off, off_t len);
+size_t view_read(const VIEW * v, byte * buff, size_t len, off_t pos);
+void view_save(const VIEW * v, const char * fname);
+void delta_make(const char * fold, const char * fnew, const char * fpatch);
+void delta_apply(const char * fold, const char * fpatch, const char * fnew);
+void delta_op(OUT * out, int type, uint64_t a, uint64_t b);
+bool delta_varint(FILE * fp, uint64_t * val);
+uint32_t delta_hash(const byte * data, off_t len);
+void hash_file(const char * fname, int algs);
+off_t dump_range(SRC * src, off_t * len);
+int hash_parse(const char * list);
+void hash_init(HASH_CTX * ctx, int algs);
+void hash_update(HASH_CTX * ctx, const byte * data, size_t len);
+void hash_print(HASH_CTX * ctx);
+void hash_parallel(SRC * src, off_t start, off_t len, HASH_CTX * ctx);
+void hash_job_set(HASH_JOB * job, const SRC * src, off_t start, off_t len, int algs);
+void * hash_job(void * arg);
+void crc_tables(void);
+uint32_t crc_slice8(uint32_t table[][256], uint32_t crc, const byte * data, size_t len);
+uint32_t crc32_update(uint32_t crc, const byte * data, size_t len);
+uint32_t crc32c_update(uint32_t crc, const byte * data, size_t len);
+uint32_t crc_combine(uint32_t crc1, uint32_t crc2, uint64_t len2, uint32_t poly);
+uint32_t adler32_update(uint32_t adler, const byte * data, size_t len);
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2);
+void xxh64_init(XXH64_CTX * ctx);
+void xxh64_update(XXH64_CTX * ctx, const byte * data, size_t len);
+uint64_t xxh64_final(const XXH64_CTX * ctx);
+void sha256_init(SHA256_CTX * ctx);
+void sha256_update(SHA256_CTX * ctx, const byte * data, size_t len);
+void sha256_final(SHA256_CTX * ctx, byte * digest);
+void sha256_blocks(uint32_t * st, const byte * data, size_t blocks);
+#ifdef X86_SIMD
+uint32_t crc32_pclmul(const byte * data, size_t len, uint32_t crc);
+uint32_t crc32c_sse42(const byte * data, size_t len, uint32_t crc);
+void sha256_blocks_shani(uint32_t * st, const byte * data, size_t blocks);
+#endif
+void serve(const char * path);
+bool srv_read(SRV_CLIENT * cl, SRV_FILE * files, OUT * out);
+bool srv_request(int fd, const char * line, SRV_FILE * files, OUT * out);
+int srv_split(char * line, char ** argv);
+SRV_FILE * srv_file(SRV_FILE * files, const char * path, char * err, size_t err_len);
+void srv_drop(SRV_FILE * f);
+SRV_ENTRY * srv_cached(SRV_FILE * f, const char * req);
+void srv_cache(SRV_FILE * f, const char * req, const char * resp, size_t len);
+bool srv_dump(SRV_FILE * f, const char * list, OUT * out, char * err, size_t err_len);
+char * srv_run(SRV_FILE * f, int argc, char ** argv, size_t * len, bool * ok);
+bool srv_reply(int fd, const char * resp, size_t len);
+void print_stats(const char * fname, long long blk);
+double * stat_parallel(SRC * src, off_t start, off_t len, long long blk, const double * xlogx, uint64_t * hist, off_t * blocks);
+void * stat_job(void * arg);
+double stat_block(const byte * data, size_t len, uint64_t * hist, const double * xlogx);
+void print_strings(const char * fname, long long min_len);
+void * str_job(void * arg);
+size_t str_scan(STR_JOB * job);
+void str_add(STR_LIST * list, size_t pos, size_t len);
+void str_print(OUT * out, const STR_JOB * job, off_t base, size_t cut);
+size_t str_find(const byte * data, size_t from, size_t to, int cls);
+#ifdef X86_SIMD
+size_t str_find_sse2(const byte * data, size_t from, size_t to, int cls);
+size_t str_find_avx2(const byte * data, size_t from, size_t to, int cls);
+#endif
 void print_file_info(const char * fname);
+void file_info(OUT * out, off_t file_end);
 void and_or_xor(char opt, const char * num1, const char * num2);
 void bit_not(const char * num);
 void check_hex_str(const char * num);